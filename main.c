@@ -8,7 +8,7 @@ It's an important architecture, that's the basic lifetime of the program.
 */
 
 /*
-This shell would be very simple, as there won't be any configuration files and there won't be any shutdown command. We will just call the looping fuction and then terminate.
+This shell would be very simple: "lsh file args..." runs a script, an interactive one reads ~/.lshrc and there won't be any shutdown command besides an EXIT trap. We will just call the looping fuction and then terminate.
 */
 
 /*
@@ -17,16 +17,59 @@ What does the shell do during its loop? a simple way to handle commands is with
 (2) Parse: Separate the command string into a program and arguments.
 (3) Excute: Run the parsed command.
 */
+#define _GNU_SOURCE             //memfd_create(), pipe2(), F_GETPIPE_SZ, splice(), tee(), copy_file_range()
 #include <stdio.h>              //fprintf(), printf(), stderr, perror()
 #include <stdlib.h>             //malloc(), realloc(), free(), exit(), execvp(), EXIT_SUCCESS, EXIT_FAILURE
 #include <sys/wait.h>           //waitpid() and associated macros
 #include <unistd.h>             //chdir(), fork(), exec(), pid_t
 #include <string.h>             //strcmp(), strtok()
+#include <fcntl.h>              //open(), fcntl(), O_CLOEXEC, O_PATH, F_GETPIPE_SZ, F_SETPIPE_SZ
+#include <sys/mman.h>           //memfd_create(), MFD_CLOEXEC
+#include <sys/stat.h>           //stat(), fstat(), struct stat
+#include <sys/syscall.h>        //syscall(), SYS_getdents64
+#include <dirent.h>             //DT_DIR, DT_LNK, DT_UNKNOWN
+#include <pthread.h>            //pthread_create(), pthread_join(), pthread_mutex_t
+#include <sched.h>              //sched_yield()
+#include <stdatomic.h>          //atomic_long, atomic_fetch_add()
+#include <signal.h>             //signal(), kill(), SIGCONT, SIGTSTP
+#include <termios.h>            //tcsetpgrp(), tcgetattr(), struct termios
+#include <sys/signalfd.h>       //signalfd(), struct signalfd_siginfo
+#include <poll.h>               //poll(), struct pollfd
+#include <limits.h>             //INT_MAX
+#include <sys/ioctl.h>          //ioctl(), TIOCGWINSZ
+#include <sys/eventfd.h>        //eventfd()
+#include <stdint.h>             //uint64_t
+#include <time.h>               //clock_gettime(), strftime()
+#include <sys/socket.h>         //socketpair(), sendmsg(), recvmsg(), SCM_RIGHTS
+#include <errno.h>              //errno, EMSGSIZE
+#include <sys/sendfile.h>       //sendfile()
+#include <sys/resource.h>       //getrlimit(), setrlimit(), RLIMIT_NOFILE
+#include <linux/mempolicy.h>    //MPOL_PREFERRED, for SYS_set_mempolicy
 #define LSH_RL_BUFSIZE 1024
 #define LSH_TOK_BUFSIZE 64
-#define LSH_TOK_DELIM "\t\r\n\a"
+#define LSH_TOK_DELIM " \t\r\a"
+#define LSH_IFS " \t\n"
+#define LSH_ARENA_CHUNK (64 * 1024)
+#define LSH_GLOB_CACHE 32
+#define LSH_DENTS_BUFSIZE (32 * 1024)
+#define LSH_GLOB_MAX_THREADS 64
+#define LSH_VAR_BUCKETS 256
+#define LSH_FUNC_BUCKETS 64
+#define LSH_FUNC_MAX_DEPTH 1000
+#define LSH_ALIAS_BUCKETS 64
+#define LSH_ALIAS_DEPTH 16
+#define LSH_SUBSHELL_SCAN_DEPTH 8
+#define LSH_ARITH_BUCKETS 256
+#define LSH_ARITH_CHAIN 4       //programs kept per bucket, the oldest goes
+#define LSH_ARITH_STACK 64
+#define LSH_HISTFILE ".lsh_history"
+#define LSH_COMPLETE_LIST 256
+#define LSH_LOAD_TTL 5     //seconds the load average in the prompt is good for
+#define LSH_RC ".lshrc"
+#define LSH_RC_MAGIC "lshsnap1"
+#define LSH_ZYGOTE_MSG (256 * 1024)     //the most a request (arguments and environment) can take
 
-//running gcc -o main main.c to compile it, and then ./main to run it on a Linux Machine
+//running gcc -pthread -o main main.c to compile it, and then ./main to run it on a Linux Machine
 
 /*
 function: lsh_read_line
@@ -34,12 +77,51 @@ We don't know ahead of time how much text a user will enter in their shell, so n
 if they do exceed it, reallocate with more space.
 */
 
-char *lsh_read_line(void){
+int lsh_wait_input(void);
+void lsh_run_exit_trap(void);
+char *lsh_edit_line(const char *prompt, int *eof);
+char *lsh_render_prompt(void);
+void lsh_rc_impure(void);
+void lsh_rc_builtin(const char *name);
+void lsh_rc_read(const char *name, size_t n, const char *value);
+void lsh_rc_wrote(const char *name);
+extern int lsh_job_control;
+extern _Thread_local int lsh_last_status;
+
+FILE *lsh_script = NULL;        //the script we run, NULL when the commands come from stdin
+_Thread_local FILE *lsh_out = NULL;     //where builtins print when they run on a thread of a pipeline
+#define LSH_STDOUT (lsh_out ? lsh_out : stdout)
+_Thread_local int lsh_in = STDIN_FILENO;     //and where they read, the pipe from the stage before
+
+char *lsh_read_line(const char *prompt){
     char* line = NULL;
     size_t bufsize = 0;    //They are using ssize_t
+    int eof = 0;
 
-    if(getline(&line, &bufsize, stdin) == -1){      //getline(array of characters, number of characters, terminator)
-        if(feof(stdin)){        //receive a EOF(end of file)
+    if(lsh_job_control){        //a terminal: we do the editing ourselves, see lsh_edit_line()
+        line = lsh_edit_line(prompt, &eof);
+        if(!eof){
+            return line;
+        }
+    }
+    else if(lsh_script != NULL){
+        if(getline(&line, &bufsize, lsh_script) == -1){        //a script has no prompt, and it ends with its last line
+            lsh_run_exit_trap();
+            exit(lsh_last_status);
+        }
+        return line;
+    }
+    else if(prompt == NULL){
+        prompt = lsh_render_prompt();
+        printf("%s", prompt);
+        free((char *)prompt);
+    }
+    else{
+        printf("%s", prompt);
+    }
+    if(eof || !lsh_wait_input() || getline(&line, &bufsize, stdin) == -1){      //getline(array of characters, number of characters, terminator)
+        if(eof || feof(stdin)){        //receive a EOF(end of file)
+            lsh_run_exit_trap();
             exit(EXIT_SUCCESS);
         }
         else{
@@ -55,25 +137,267 @@ char *lsh_read_line(void){
 
 
 /*
-we wll simply use whitespace to separate arguments from each other, that is mean we won't allow quoting or 
-backslash escaping in our command line arguments
+a per-command arena: everything that only lives as long as one command line (the tokens, the expanded words,
+the captured output of command substitutions) is bump-allocated out of big chunks and given back all at once
+when the line is done, instead of paying a malloc()/free() pair for every little string.
+*/
+struct lsh_arena_chunk{
+    struct lsh_arena_chunk *next;
+    size_t size, used;
+    char data[];
+};
+
+struct lsh_arena_chunk *lsh_arena = NULL;
+
+void *lsh_arena_alloc(size_t n){
+    struct lsh_arena_chunk *chunk = lsh_arena;
+    size_t size;
+
+    n = (n + sizeof(void*) - 1) & ~(sizeof(void*) - 1);       //keep every block pointer aligned
+    if(chunk == NULL || chunk->size - chunk->used < n){
+        size = n > LSH_ARENA_CHUNK ? n : LSH_ARENA_CHUNK;
+        chunk = malloc(sizeof(*chunk) + size);
+        if(!chunk){
+            fprintf(stderr,"lsh: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        chunk->next = lsh_arena;
+        chunk->size = size;
+        chunk->used = 0;
+        lsh_arena = chunk;
+    }
+    chunk->used += n;
+    return chunk->data + chunk->used - n;
+}
+
+char *lsh_arena_strndup(const char *s, size_t n){
+    char *copy = lsh_arena_alloc(n + 1);
+
+    memcpy(copy, s, n);
+    copy[n] = '\0';
+    return copy;
+}
+
+//keep one regular sized chunk around for the next line, everything else goes back to malloc.
+void lsh_arena_reset(void){
+    struct lsh_arena_chunk *chunk, *next;
+
+    if(lsh_arena == NULL){
+        return;
+    }
+    for(chunk = lsh_arena->next; chunk != NULL; chunk = next){
+        next = chunk->next;
+        free(chunk);
+    }
+    lsh_arena->next = NULL;
+    lsh_arena->used = 0;
+    if(lsh_arena->size > LSH_ARENA_CHUNK){
+        free(lsh_arena);
+        lsh_arena = NULL;
+    }
+}
+
+/*
+a loop runs its body over and over within the same command line, so it takes a mark before each round and releases
+everything allocated after it when the round is done, that keeps the arena flat no matter how many rounds there are.
+*/
+struct lsh_arena_pos{
+    struct lsh_arena_chunk *chunk;
+    size_t used;
+};
+
+struct lsh_arena_pos lsh_arena_mark(void){
+    struct lsh_arena_pos pos = {lsh_arena, lsh_arena ? lsh_arena->used : 0};
+
+    return pos;
+}
+
+void lsh_arena_release(struct lsh_arena_pos pos){
+    struct lsh_arena_chunk *next;
+
+    while(lsh_arena != NULL && lsh_arena != pos.chunk){
+        next = lsh_arena->next;
+        free(lsh_arena);
+        lsh_arena = next;
+    }
+    if(lsh_arena != NULL){
+        lsh_arena->used = pos.used;
+    }
+}
+
+//a string and an argument list that grow as we append to them, the memory comes from malloc().
+struct lsh_str{
+    char *data;
+    size_t len, cap;
+};
+
+struct lsh_argv{
+    char **v;
+    int len, cap;
+};
+
+void lsh_str_append(struct lsh_str *str, const char *s, size_t n){
+    if(str->len + n + 1 > str->cap){
+        str->cap = (str->len + n + 1) * 2;
+        str->data = realloc(str->data, str->cap);
+        if(!str->data){
+            fprintf(stderr,"lsh: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(str->data + str->len, s, n);
+    str->len += n;
+    str->data[str->len] = '\0';
+}
+
+void lsh_argv_push(struct lsh_argv *argv, char *word){
+    if(argv->len + 2 > argv->cap){
+        argv->cap = argv->cap ? argv->cap * 2 : LSH_TOK_BUFSIZE;
+        argv->v = realloc(argv->v, argv->cap * sizeof(char*));
+        if(!argv->v){
+            fprintf(stderr,"lsh: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    argv->v[argv->len++] = word;
+    argv->v[argv->len] = NULL;
+}
+
+/*
+we use whitespace to separate arguments from each other, but text inside '...', "..." or $(...) and characters
+after a backslash stay in one word. the quotes are kept in the token, they are only removed when the word is expanded
+right before the command runs, because that is also the moment we need to know what was quoted.
+
+some character sequences are operators and end a word even without whitespace around them ("cat <<EOF").
+a newline is an operator too, it ends a command just like ";".
 */
+char *lsh_operators[] = {       //longest first, so "<<<" is not taken for "<<"
+    "<<<",
+    "<<-",
+    "<<",
+    "&&",
+    "||",
+    "|",
+    "&",
+    ";",
+    "(",
+    ")",
+    "\n"
+};
+
+int lsh_operator_length(const char *p){
+    int i;
+
+    for(i = 0; i < (int)(sizeof(lsh_operators) / sizeof(char*)); i++){
+        if(strncmp(p, lsh_operators[i], strlen(lsh_operators[i])) == 0){
+            return strlen(lsh_operators[i]);
+        }
+    }
+    return 0;
+}
+
+//find the ')' that closes a "$(", p points right after it. nested parentheses and quoted text are skipped.
+const char *lsh_match_paren(const char *p){
+    int depth = 1;
+    char quote;
+
+    for(; *p != '\0'; p++){
+        if(*p == '\\' && p[1] != '\0'){
+            p++;
+        }
+        else if(*p == '\'' || *p == '"'){
+            quote = *p++;
+            while(*p != '\0' && *p != quote){
+                if(quote == '"' && *p == '\\' && p[1] != '\0'){
+                    p++;
+                }
+                p++;
+            }
+            if(*p == '\0'){
+                return NULL;
+            }
+        }
+        else if(*p == '('){
+            depth++;
+        }
+        else if(*p == ')' && --depth == 0){
+            return p;
+        }
+    }
+    return NULL;
+}
+
+//the length of the token that starts at p, or -1 if a quote or a "$(" is never closed.
+int lsh_token_length(const char *p){
+    const char *start = p, *end;
+    int dquote = 0;
+
+    if(lsh_operator_length(p) > 0){
+        return lsh_operator_length(p);
+    }
+
+    while(*p != '\0' && (dquote || (strchr(LSH_TOK_DELIM, *p) == NULL && lsh_operator_length(p) == 0))){
+        if(*p == '\\' && p[1] != '\0'){
+            p += 2;
+        }
+        else if(*p == '\'' && !dquote){
+            end = strchr(p + 1, '\'');
+            if(end == NULL){
+                return -1;
+            }
+            p = end + 1;
+        }
+        else if(*p == '"'){
+            dquote = !dquote;
+            p++;
+        }
+        else if(*p == '$' && p[1] == '('){
+            end = lsh_match_paren(p + 2);
+            if(end == NULL){
+                return -1;
+            }
+            p = end + 1;
+        }
+        else if(*p == '$' && p[1] == '{'){
+            end = strchr(p + 2, '}');
+            if(end == NULL){
+                return -1;
+            }
+            p = end + 1;
+        }
+        else{
+            p++;
+        }
+    }
+    return dquote ? -1 : p - start;
+}
+
 char **lsh_split_line(char* line){
-    int bufsize = LSH_TOK_BUFSIZE, position = 0;
+    int bufsize = LSH_TOK_BUFSIZE, position = 0, len;
     char **tokens = malloc(bufsize * sizeof(char*));        //array of pointers
-    char * token;           
 
     if(!tokens){
         fprintf(stderr,"lsh: allocation error\n");
         exit(EXIT_FAILURE);
     }
 
-    token = strtok(line, LSH_TOK_DELIM);        //it returns a pointer to the first token 
-    //strtok() actually does it return pointers to within the string you give it, and place \0 bytes at the end of each token
-
-    while(token != NULL){       //the process repeats until no token is returned by strtok
-        tokens[position] = token;       //we store each pointer in an array (buffer) of character pointers.
+    for(;;){
+        line += strspn(line, LSH_TOK_DELIM);
+        if(*line == '#'){       //the rest of the line is a comment
+            line += strcspn(line, "\n");
+        }
+        if(*line == '\0'){
+            break;
+        }
+        len = lsh_token_length(line);
+        if(len < 0){
+            fprintf(stderr, "lsh: syntax error: unterminated quote or command substitution\n");
+            position = 0;       //run nothing of a broken line
+            break;
+        }
+        tokens[position] = lsh_arena_strndup(line, len);       //we store each token in an array (buffer) of character pointers.
         position++;
+        line += len;
 
         if(position >= bufsize){
             bufsize += LSH_TOK_BUFSIZE;
@@ -83,7 +407,6 @@ char **lsh_split_line(char* line){
                 exit(EXIT_FAILURE);
             }
         }
-        token = strtok(NULL, LSH_TOK_DELIM);        //we null-terminate the list of tokens, because no tokens will be returned by strtok.
     }
     tokens[position] = NULL;
     return tokens;
@@ -91,167 +414,8402 @@ char **lsh_split_line(char* line){
 }
 
 /*
-two ways of starting processes on Unix. The first one is by being init.
+the tokens of a line are parsed into a tree of nodes before anything runs:
+ - a simple command (LSH_NODE_CMD) is a list of words, together with its redirections.
+ - "a | b" is a LSH_NODE_PIPE, "a &" runs a in the background and is a LSH_NODE_BG.
+ - "a ; b" and a newline between commands make a LSH_NODE_SEQ, "a && b" and "a || b" a LSH_NODE_AND and LSH_NODE_OR.
+ - "for name in words; do list; done" is a LSH_NODE_FOR.
+ - "name() { list; }" defines a function, a LSH_NODE_FUNC.
+ - "( list )" runs the list in a subshell (LSH_NODE_SUBSHELL), "{ list; }" is just a group of commands (LSH_NODE_GROUP).
+a command that is not finished at the end of the line (a "for" without its "done") makes the parser ask for more lines.
+*/
+enum{
+    LSH_NODE_CMD,
+    LSH_NODE_PIPE,
+    LSH_NODE_BG,
+    LSH_NODE_SEQ,
+    LSH_NODE_AND,
+    LSH_NODE_OR,
+    LSH_NODE_FOR,
+    LSH_NODE_FUNC,
+    LSH_NODE_SUBSHELL,
+    LSH_NODE_GROUP
+};
 
-when a Unix computer boots, its kernel is loaded. Once it is loaded and initialized, the kernel
-starts only one process, which is called init. This process runs for the intire length of time that
-the computer is on, and it manages loading up the rest of the processes that you need for your cpomputer to be useful.
+struct lsh_node{
+    int type;
+    char **words;       //CMD: the raw words of the command, FOR: the words to loop over
+    char *name;         //FOR: the loop variable, FUNC: the function's name
+    struct lsh_node *left, *right;      //PIPE, SEQ, AND, OR: both sides, BG, SUBSHELL, GROUP: left, FOR and FUNC: right is the body
+};
 
-most programs aren't init, the other one is the fork() system call.
+struct lsh_parser{
+    char **tokens;
+    int pos;
+    int incomplete;     //the tokens ran out in the middle of a command
+    int error;
+};
 
-when this function is called, the OS makes a duplicate of the process and starts them both running. The original process is called the "parent"
-and the new one is called the "child". fork() returns 0 to the child process, and it returns to the parent the process ID (PID) of its child.
-This mean that the only way for new processes is to start it by an exiting one duplicating itself.
+struct lsh_node *lsh_new_node(int type, struct lsh_node *left, struct lsh_node *right){
+    struct lsh_node *node = lsh_arena_alloc(sizeof(*node));
 
-exec() system call, it could replace the current running program with an entirely new one, this mean that when you call exec, the OS stops your process,
-loads up the new program, and starts that one in its place. A process never returns from an exec() call (unless that's an error).
+    memset(node, 0, sizeof(*node));
+    node->type = type;
+    node->left = left;
+    node->right = right;
+    return node;
+}
 
-Now, we are going to build blocks for how most programs are run on Unix.
-First, an existing process forks itself into two separate ones. Then, the child uses exec() to replace itself with a new program.
-The parent process can continue doing other things, and it can keep tags on its children, using the system call wait()
-*/
+int lsh_is_token(const char *tok, const char *str){
+    return tok != NULL && strcmp(tok, str) == 0;
+}
 
-int lsh_launch(char** args){
-    //pid_t data type stands for process identification and it is used to represent process ids
-    pid_t pid, wpid;
-    int status;
+int lsh_is_operator(const char *tok){
+    return tok != NULL && lsh_operator_length(tok) == (int)strlen(tok);
+}
 
-    pid = fork();
-    if(pid == 0){
-        //children
-        if(execvp(args[0], args) == -1){        //if the exec system call returns -1 or if it returns, we know there was an error
-            perror("lsh");      //we use perror to print the system's error message, along with our program name
-        }
-        exit(EXIT_FAILURE);     //then, we exit so the shell can keep running.
-    }
-    else if (pid < 0)
-    {
-        //error forking
-        perror("lsh");  
+int lsh_is_name(const char *p, size_t n){
+    size_t i;
+
+    if(n == 0 || (p[0] >= '0' && p[0] <= '9')){
+        return 0;
     }
-    else{           //fork() execute successfully
-        //parent process
-        do{
-            wpid = waitpid(pid, &status, WUNTRACED);
-        }while(!WIFEXITED(status) && !WIFSIGNALED(status));
+    for(i = 0; i < n; i++){
+        if(!(p[i] == '_' || (p[i] >= 'a' && p[i] <= 'z') || (p[i] >= 'A' && p[i] <= 'Z') || (p[i] >= '0' && p[i] <= '9'))){
+            return 0;
+        }
     }
     return 1;
 }
 
-/*
-most commands execute by a shell are programs, but not all of them, some of them are built right into the shell.
+void lsh_syntax_error(struct lsh_parser *ps){
+    char *tok = ps->tokens[ps->pos];
 
-these commands could only cange the shell's operation if they were implemented within the shell proces itself.\
+    if(tok == NULL){
+        ps->incomplete = 1;     //not wrong, just not finished yet
+        return;
+    }
+    if(!ps->error){
+        fprintf(stderr, "lsh: syntax error near unexpected token `%s'\n", strcmp(tok, "\n") == 0 ? "newline" : tok);
+    }
+    ps->error = 1;
+}
 
-the shell process itself needs to execute chdir(), so that its own current directory is updated, then, when it launches child processes, 
-they will inherit that directory too.
+void lsh_skip_newlines(struct lsh_parser *ps){
+    while(lsh_is_token(ps->tokens[ps->pos], "\n")){
+        ps->pos++;
+    }
+}
 
-Now, we are going to add some commands to the shell itself, like cd, exit and help.
-*/
-int lsh_cd(char** args);
-int lsh_help(char**args);
-int lsh_exit(char** args);      //forward declarations
+struct lsh_node *lsh_parse_list(struct lsh_parser *ps, const char *terminator);
 
-//an array of builtin command names
-char * builtin_str[] = {
-    "cd",
-    "help",
-    "exit"
-};
+struct lsh_node *lsh_parse_for(struct lsh_parser *ps){
+    struct lsh_node *node = lsh_new_node(LSH_NODE_FOR, NULL, NULL);
+    char *tok;
+    int start, i;
 
-//an array of their corresponding functions
-int (*builtin_func[]) (char**) = {      //it is an array of function pointers (that take array of strings and return an int)
-    &lsh_cd,
-    &lsh_help,
-    &lsh_exit
-};
+    ps->pos++;
+    tok = ps->tokens[ps->pos];
+    if(tok == NULL || !lsh_is_name(tok, strlen(tok))){
+        lsh_syntax_error(ps);
+        return NULL;
+    }
+    node->name = tok;
+    ps->pos++;
+    lsh_skip_newlines(ps);
 
-int lsh_num_builtis(){
-    return sizeof(builtin_str) / sizeof(char*);
+    start = ps->pos;
+    if(lsh_is_token(ps->tokens[ps->pos], "in")){
+        for(ps->pos++, start = ps->pos; ps->tokens[ps->pos] != NULL && !lsh_is_operator(ps->tokens[ps->pos]); ps->pos++){
+        }
+    }
+    node->words = lsh_arena_alloc((ps->pos - start + 1) * sizeof(char*));
+    for(i = start; i < ps->pos; i++){
+        node->words[i - start] = ps->tokens[i];
+    }
+    node->words[ps->pos - start] = NULL;
+
+    if(lsh_is_token(ps->tokens[ps->pos], ";")){
+        ps->pos++;
+    }
+    lsh_skip_newlines(ps);
+    if(!lsh_is_token(ps->tokens[ps->pos], "do")){
+        lsh_syntax_error(ps);
+        return NULL;
+    }
+    ps->pos++;
+    node->right = lsh_parse_list(ps, "done");
+    if(ps->error || ps->incomplete){
+        return NULL;
+    }
+    if(!lsh_is_token(ps->tokens[ps->pos], "done")){
+        lsh_syntax_error(ps);
+        return NULL;
+    }
+    ps->pos++;
+    return node;
 }
 
-int lsh_cd(char** args){        //implement cd
-    if(args[1] == NULL){        //if its second argument does not exist, then print an error message.
-        fprintf(stderr, "lsh: expected argument to \"cd\"\n");
+struct lsh_node *lsh_parse_function(struct lsh_parser *ps){
+    struct lsh_node *node = lsh_new_node(LSH_NODE_FUNC, NULL, NULL);
+
+    node->name = ps->tokens[ps->pos];
+    ps->pos += 2;
+    if(!lsh_is_token(ps->tokens[ps->pos], ")")){
+        lsh_syntax_error(ps);
+        return NULL;
     }
-    else{
-        if(chdir(args[1]) != 0)     //call chdir(), check for errors, and returns
-            perror("lsh");
+    ps->pos++;
+    lsh_skip_newlines(ps);
+    if(!lsh_is_token(ps->tokens[ps->pos], "{")){
+        lsh_syntax_error(ps);
+        return NULL;
     }
-    return 1;
+    ps->pos++;
+    node->right = lsh_parse_list(ps, "}");
+    if(ps->error || ps->incomplete){
+        return NULL;
+    }
+    if(!lsh_is_token(ps->tokens[ps->pos], "}")){
+        lsh_syntax_error(ps);
+        return NULL;
+    }
+    ps->pos++;
+    return node;
 }
 
+struct lsh_node *lsh_parse_list(struct lsh_parser *ps, const char *terminator);
 
-//the help function prints a nice message and the names of all the buitins.
-int lsh_help(char** args){
-    int i;
-    printf("LSH\n");
-    printf("Type program names and arguments, and hit enter.\n");
-    printf("The following are built in:\n");
+//"( list )" or "{ list; }", close is ")" or "}".
+struct lsh_node *lsh_parse_group(struct lsh_parser *ps, int type, const char *close){
+    struct lsh_node *node = lsh_new_node(type, NULL, NULL);
 
-    for(i = 0; i < lsh_num_builtis(); i++){
-        printf(" %s\n", builtin_str[i]);
+    ps->pos++;
+    node->left = lsh_parse_list(ps, close);
+    if(ps->error || ps->incomplete){
+        return NULL;
     }
+    if(node->left == NULL || !lsh_is_token(ps->tokens[ps->pos], close)){
+        lsh_syntax_error(ps);
+        return NULL;
+    }
+    ps->pos++;
+    return node;
+}
 
-    printf("Use the man command for information on other programs.\n");
-    return 1;
+struct lsh_node *lsh_parse_command(struct lsh_parser *ps){
+    struct lsh_node *node;
+    char *tok = ps->tokens[ps->pos];
+    int start = ps->pos, i;
 
-}
+    if(lsh_is_token(tok, "for")){
+        return lsh_parse_for(ps);
+    }
+    if(lsh_is_token(tok, "(")){
+        return lsh_parse_group(ps, LSH_NODE_SUBSHELL, ")");
+    }
+    if(lsh_is_token(tok, "{")){
+        return lsh_parse_group(ps, LSH_NODE_GROUP, "}");
+    }
+    if(tok != NULL && !lsh_is_operator(tok) && lsh_is_name(tok, strlen(tok)) && lsh_is_token(ps->tokens[ps->pos + 1], "(")){
+        return lsh_parse_function(ps);
+    }
 
-//the exit function returns 0, as a signal for the command loop to terminate.
-int lsh_exit(char** args){
-    return 0;
+    while((tok = ps->tokens[ps->pos]) != NULL && (!lsh_is_operator(tok) || strncmp(tok, "<<", 2) == 0)){
+        if(lsh_is_operator(tok) && ps->tokens[++ps->pos] == NULL){
+            lsh_syntax_error(ps);       //a redirection without its word
+            return NULL;
+        }
+        ps->pos++;
+    }
+    if(ps->pos == start){
+        lsh_syntax_error(ps);
+        return NULL;
+    }
+
+    node = lsh_new_node(LSH_NODE_CMD, NULL, NULL);
+    node->words = lsh_arena_alloc((ps->pos - start + 1) * sizeof(char*));
+    for(i = start; i < ps->pos; i++){
+        node->words[i - start] = ps->tokens[i];
+    }
+    node->words[ps->pos - start] = NULL;
+    return node;
 }
 
+struct lsh_node *lsh_parse_pipeline(struct lsh_parser *ps){
+    struct lsh_node *node, *right;
 
-//this function will either launch a builtin, or a process.
-int lsh_execute(char** args){
-    int i;
+    node = lsh_parse_command(ps);
+    while(node != NULL && lsh_is_token(ps->tokens[ps->pos], "|")){
+        ps->pos++;
+        lsh_skip_newlines(ps);
+        right = lsh_parse_command(ps);
+        node = right ? lsh_new_node(LSH_NODE_PIPE, node, right) : NULL;
+    }
+    return node;
+}
 
-    if(args[0] == NULL){
-        // an empty command was entered
-        return 1;
+struct lsh_node *lsh_parse_and_or(struct lsh_parser *ps){
+    struct lsh_node *node, *right;
+    int type;
+
+    node = lsh_parse_pipeline(ps);
+    while(node != NULL && (lsh_is_token(ps->tokens[ps->pos], "&&") || lsh_is_token(ps->tokens[ps->pos], "||"))){
+        type = lsh_is_token(ps->tokens[ps->pos], "&&") ? LSH_NODE_AND : LSH_NODE_OR;
+        ps->pos++;
+        lsh_skip_newlines(ps);
+        right = lsh_parse_pipeline(ps);
+        node = right ? lsh_new_node(type, node, right) : NULL;
     }
+    return node;
+}
 
-    for(i = 0; i < lsh_num_builtis(); i++){
-        if(strcmp(args[0], builtin_str[i]) == 0){ //to check if the command equals each builtin
-            return (*builtin_func[i])(args);   //if so, run it
+//parse commands separated by ";", "&" or newlines, up to the end of the tokens or the terminator word ("done" of a loop).
+struct lsh_node *lsh_parse_list(struct lsh_parser *ps, const char *terminator){
+    struct lsh_node *node = NULL, *item;
+    char *tok;
+
+    for(;;){
+        lsh_skip_newlines(ps);
+        tok = ps->tokens[ps->pos];
+        if(tok == NULL || (terminator != NULL && lsh_is_token(tok, terminator))){
+            break;
+        }
+        item = lsh_parse_and_or(ps);
+        if(item == NULL){
+            return NULL;
+        }
+        tok = ps->tokens[ps->pos];
+        if(lsh_is_token(tok, "&")){
+            item = lsh_new_node(LSH_NODE_BG, item, NULL);
+        }
+        node = node ? lsh_new_node(LSH_NODE_SEQ, node, item) : item;
+
+        if(lsh_is_token(tok, ";") || lsh_is_token(tok, "\n") || lsh_is_token(tok, "&")){
+            ps->pos++;
+        }
+        else if(tok != NULL && !(terminator != NULL && lsh_is_token(tok, terminator))){
+            lsh_syntax_error(ps);
+            return NULL;
         }
     }
-    return lsh_launch(args);    //if doesn't match a builtin, it calls lsh_launch() to launch the process.
+    if(terminator != NULL && ps->tokens[ps->pos] == NULL){
+        ps->incomplete = 1;
+    }
+    return node;
+}
+
+/*
+function: lsh_parse
+parse a whole command line, *incomplete is set if the tokens end in the middle of a command and the caller should
+append the tokens of the next line and try again. on a syntax error it returns NULL.
+*/
+struct lsh_node *lsh_parse(char **tokens, int *incomplete){
+    struct lsh_parser ps = {tokens, 0, 0, 0};
+    struct lsh_node *node;
 
+    node = lsh_parse_list(&ps, NULL);
+    if(!ps.incomplete && !ps.error && tokens[ps.pos] != NULL){
+        lsh_syntax_error(&ps);
+    }
+    *incomplete = ps.incomplete && !ps.error;
+    return (ps.error || ps.incomplete) ? NULL : node;
 }
 
-void lsh_loop(void)
-{
-    char *line;
-    char **args;
-    int status;
+/*
+two ways of starting processes on Unix. The first one is by being init.
 
-    //the do-while loop is more convienient for checking the status variable, 
-    //because it executes once before checking its value.
-    do{
-        printf("> ");       //print a prompt
-        line = lsh_read_line();     //call a function to read a line
-        args = lsh_split_line(line);        //call a function to split the line into args
-        status = lsh_execute(args);         //excute the args
+when a Unix computer boots, its kernel is loaded. Once it is loaded and initialized, the kernel
+starts only one process, which is called init. This process runs for the intire length of time that
+the computer is on, and it manages loading up the rest of the processes that you need for your cpomputer to be useful.
 
-        free(line);
-        free(args);         //free the line and arguments that we created earlier.
-    }while(status);         //using a status variable returned by lsh_executed() to determine when to exit.
+most programs aren't init, the other one is the fork() system call.
 
+when this function is called, the OS makes a duplicate of the process and starts them both running. The original process is called the "parent"
+and the new one is called the "child". fork() returns 0 to the child process, and it returns to the parent the process ID (PID) of its child.
+This mean that the only way for new processes is to start it by an exiting one duplicating itself.
 
-}
+exec() system call, it could replace the current running program with an entirely new one, this mean that when you call exec, the OS stops your process,
+loads up the new program, and starts that one in its place. A process never returns from an exec() call (unless that's an error).
 
-int main(int argc, char **argv)
-{
-    // TODO: Load confi files, if any. 
-    // TODO: Run command loop.
-    lsh_loop();
+Now, we are going to build blocks for how most programs are run on Unix.
+First, an existing process forks itself into two separate ones. Then, the child uses exec() to replace itself with a new program.
+The parent process can continue doing other things, and it can keep tags on its children, using the system call wait()
+*/
 
-    // TODO: Perform any shutdown/clearup
+//the exit status of the last command, that's what $? gives, && and || look at and a loop ends with.
+_Thread_local int lsh_last_status = 0;     //each thread its own, see lsh_stage_builtin()
+_Thread_local int lsh_prev_status = 0;        //$? from before the running builtin started, "return" without a number uses it
+
+/*
+job control. a job is a pipeline (a single command is a pipeline of one), and all the processes of a job are put
+into a process group of their own, whose id is the pid of its first process. the terminal only sends Ctrl-C and Ctrl-Z
+to its foreground process group, so handing the terminal to a job with tcsetpgrp() makes those keys reach the job and
+not the shell. when a foreground job stops (Ctrl-Z) we take the terminal back and keep the job in the table, where
+fg, bg, jobs and kill %n can get at it.
+
+an interactive shell does this, a shell that reads a script just runs its commands in its own process group.
+*/
+enum{
+    LSH_PROC_RUNNING,
+    LSH_PROC_STOPPED,
+    LSH_PROC_DONE
+};
+
+struct lsh_job{
+    struct lsh_job *next;
+    int id;     //the n of %n
+    pid_t pgid;
+    pid_t *pids;
+    int *states, *statuses;
+    int npids;
+    char *text;     //the command line, for "jobs"
+    struct termios tmodes;      //the terminal settings the job had when it stopped
+    int has_tmodes;
+    int background;
+    int cgroup;     //the job's cgroup directory with "set -o cgroups=1", or -1
+    char *cgroup_path;
+};
 
-    return EXIT_SUCCESS;
+struct lsh_job *lsh_jobs = NULL;
+int lsh_job_control = 0;
+int lsh_tty_fd = -1;
+struct termios lsh_shell_tmodes;
+pid_t lsh_last_bg_pid = 0;      //$!
+int lsh_exec_direct = 0;        //set in a forked child whose command should exec in place instead of forking again
+char **lsh_cmd_assigns = NULL;      //the NAME=value words in front of the builtin that runs, for the command of ulimit, pin or memo
+int lsh_interrupted = 0;        //set by Ctrl-C, the rest of the command line is skipped
 
+void lsh_init_job_control(void){
+    pid_t pgid;
 
-}
\ No newline at end of file
+    if(!isatty(STDIN_FILENO)){
+        return;
+    }
+    //if we were started in the background, wait until we are brought to the foreground
+    while(tcgetpgrp(STDIN_FILENO) != (pgid = getpgrp())){
+        kill(-pgid, SIGTTIN);
+    }
+    signal(SIGTSTP, SIG_IGN);       //Ctrl-Z stops the job, never the shell
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);       //we call tcsetpgrp() while we are not in the foreground
+
+    if(getpid() != getpgrp() && setpgid(0, 0) < 0){
+        perror("lsh: setpgid");
+        return;
+    }
+    lsh_tty_fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);      //stdin may be redirected later, the terminal stays here
+    tcsetpgrp(lsh_tty_fd, getpgrp());
+    tcgetattr(lsh_tty_fd, &lsh_shell_tmodes);
+    lsh_job_control = 1;
+}
+
+void lsh_reset_signals(void);
+void lsh_cgroup_attach(struct lsh_job *job);
+void lsh_cgroup_enter(struct lsh_job *job, pid_t pid);
+void lsh_cgroup_release(struct lsh_job *job);
+extern int lsh_use_cgroups;
+void lsh_apply_cmd_limits(void);
+extern int lsh_cmd_limited;
+struct lsh_placement;
+void lsh_place(struct lsh_placement *place);
+extern struct lsh_placement lsh_cmd_place;
+extern int lsh_cmd_placed;
+
+//what a forked child does before it runs anything: join the job's group, maybe take the terminal, reset the signals.
+void lsh_child_setup(pid_t pgid, int foreground){
+    if(lsh_job_control){
+        setpgid(0, pgid);
+        if(foreground){
+            tcsetpgrp(lsh_tty_fd, pgid ? pgid : getpid());
+        }
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGTTIN, SIG_DFL);
+        signal(SIGTTOU, SIG_DFL);
+    }
+    lsh_reset_signals();
+    lsh_job_control = 0;        //a job doesn't manage jobs of its own
+    lsh_jobs = NULL;        //nor the shell's, they are not its children to wait for
+    lsh_use_cgroups = 0;        //and what it starts stays in the cgroup of its job
+}
+
+struct lsh_job *lsh_new_job(const char *text, int background){
+    struct lsh_job *job = calloc(1, sizeof(*job)), **link;
+    int id = 1;
+
+    if(!job || !(job->text = strdup(text))){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    //the lowest free number, the list is kept sorted by it
+    for(link = &lsh_jobs; *link != NULL && (*link)->id == id; link = &(*link)->next){
+        id++;
+    }
+    job->id = id;
+    job->background = background;
+    job->next = *link;
+    *link = job;
+    lsh_cgroup_attach(job);
+    return job;
+}
+
+void lsh_job_add_pid(struct lsh_job *job, pid_t pid){
+    job->pids = realloc(job->pids, (job->npids + 1) * sizeof(pid_t));
+    job->states = realloc(job->states, (job->npids + 1) * sizeof(int));
+    job->statuses = realloc(job->statuses, (job->npids + 1) * sizeof(int));
+    if(!job->pids || !job->states || !job->statuses){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    if(job->npids == 0){
+        job->pgid = pid;
+    }
+    job->pids[job->npids] = pid;
+    job->states[job->npids] = LSH_PROC_RUNNING;
+    job->statuses[job->npids] = 0;
+    job->npids++;
+    lsh_cgroup_enter(job, pid);     //the child does it too, like setpgid()
+}
+
+void lsh_free_job(struct lsh_job *job){
+    struct lsh_job **link;
+
+    for(link = &lsh_jobs; *link != NULL; link = &(*link)->next){
+        if(*link == job){
+            *link = job->next;
+            break;
+        }
+    }
+    lsh_cgroup_release(job);
+    free(job->pids);
+    free(job->states);
+    free(job->statuses);
+    free(job->text);
+    free(job);
+}
+
+//the state of a whole job: running while any process runs, stopped if none runs but one is stopped, done otherwise.
+int lsh_job_state(struct lsh_job *job){
+    int i, state = LSH_PROC_DONE;
+
+    for(i = 0; i < job->npids; i++){
+        if(job->states[i] == LSH_PROC_RUNNING){
+            return LSH_PROC_RUNNING;
+        }
+        if(job->states[i] == LSH_PROC_STOPPED){
+            state = LSH_PROC_STOPPED;
+        }
+    }
+    return state;
+}
+
+//record what waitpid() told us about pid in whatever job it belongs to.
+void lsh_mark_process(pid_t pid, int status){
+    struct lsh_job *job;
+    int i;
+
+    for(job = lsh_jobs; job != NULL; job = job->next){
+        for(i = 0; i < job->npids; i++){
+            if(job->pids[i] == pid){
+                if(WIFSTOPPED(status)){
+                    job->states[i] = LSH_PROC_STOPPED;
+                }
+                else if(WIFCONTINUED(status)){
+                    job->states[i] = LSH_PROC_RUNNING;
+                }
+                else{
+                    job->states[i] = LSH_PROC_DONE;
+                    job->statuses[i] = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+                }
+                return;
+            }
+        }
+    }
+}
+
+//send a signal to every process of a job. without job control they share our process group, so one by one.
+int lsh_signal_job(struct lsh_job *job, int sig){
+    int i, ret = 0;
+
+    if(lsh_job_control){
+        return kill(-job->pgid, sig);
+    }
+    for(i = 0; i < job->npids; i++){
+        if(job->states[i] != LSH_PROC_DONE && kill(job->pids[i], sig) < 0){
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+//the exit status of a finished job is the one of its last process.
+int lsh_job_status(struct lsh_job *job){
+    return job->npids > 0 ? job->statuses[job->npids - 1] : 0;
+}
+
+char *lsh_job_state_str[] = {"Running", "Stopped", "Done"};
+
+void lsh_print_job(struct lsh_job *job, FILE *out){
+    struct lsh_job *last;
+
+    for(last = job; last->next != NULL; last = last->next){
+    }
+    fprintf(out, "[%d]%c  %-22s %s\n", job->id, job == last ? '+' : ' ', lsh_job_state_str[lsh_job_state(job)], job->text);
+}
+
+/*
+wait until the job is not running anymore. the children of other jobs that finish meanwhile are recorded too.
+*/
+void lsh_wait_job(struct lsh_job *job){
+    pid_t pid;
+    int status;
+
+    while(lsh_job_state(job) == LSH_PROC_RUNNING){
+        pid = waitpid(-1, &status, WUNTRACED);
+        if(pid < 0){
+            break;      //nothing left to wait for
+        }
+        lsh_mark_process(pid, status);
+    }
+}
+
+//run a job in the foreground: give it the terminal, wait for it, and take the terminal back.
+void lsh_foreground_job(struct lsh_job *job, int cont){
+    int i;
+
+    job->background = 0;
+    if(lsh_job_control){
+        tcsetpgrp(lsh_tty_fd, job->pgid);
+        if(cont && job->has_tmodes){
+            tcsetattr(lsh_tty_fd, TCSADRAIN, &job->tmodes);
+        }
+    }
+    if(cont){
+        lsh_signal_job(job, SIGCONT);
+        for(i = 0; i < job->npids; i++){
+            if(job->states[i] == LSH_PROC_STOPPED){
+                job->states[i] = LSH_PROC_RUNNING;
+            }
+        }
+    }
+
+    lsh_wait_job(job);
+
+    if(lsh_job_control){
+        tcsetpgrp(lsh_tty_fd, getpgrp());
+        job->has_tmodes = tcgetattr(lsh_tty_fd, &job->tmodes) == 0;
+        tcsetattr(lsh_tty_fd, TCSADRAIN, &lsh_shell_tmodes);
+    }
+    if(lsh_job_state(job) == LSH_PROC_STOPPED){
+        fprintf(stderr, "\n");
+        lsh_print_job(job, stderr);
+        job->background = 1;
+        lsh_last_status = 128 + SIGTSTP;
+    }
+    else{
+        lsh_last_status = lsh_job_status(job);
+        if(lsh_job_control && lsh_last_status == 128 + SIGINT){
+            lsh_interrupted = 1;        //Ctrl-C stops the whole command line, not just the job that got it
+            fprintf(stderr, "\n");
+        }
+        lsh_free_job(job);
+    }
+}
+
+/*
+function: lsh_reap_jobs
+collect the background children that finished or stopped without blocking, and tell the user about the jobs that are
+done. the loop calls it before every prompt.
+*/
+void lsh_reap_jobs(void){
+    struct lsh_job *job, *next;
+    pid_t pid;
+    int status;
+
+    while((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0){
+        lsh_mark_process(pid, status);
+    }
+    for(job = lsh_jobs; job != NULL; job = next){
+        next = job->next;
+        if(job->background && lsh_job_state(job) == LSH_PROC_DONE){
+            if(lsh_job_control){
+                lsh_print_job(job, stderr);
+            }
+            lsh_free_job(job);
+        }
+    }
+}
+
+//find the job an argument like "%2", "%%" or "%+" means, no argument means the most recent one.
+struct lsh_job *lsh_find_job(const char *spec){
+    struct lsh_job *job, *last = NULL;
+    int id;
+
+    for(job = lsh_jobs; job != NULL; job = job->next){
+        last = job;
+    }
+    if(spec == NULL || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0 || strcmp(spec, "%") == 0){
+        return last;
+    }
+    id = atoi(spec + (spec[0] == '%'));
+    for(job = lsh_jobs; job != NULL; job = job->next){
+        if(job->id == id){
+            return job;
+        }
+    }
+    return NULL;
+}
+
+//the text of a command tree, for the job table.
+void lsh_node_text(struct lsh_node *node, struct lsh_str *out){
+    static char *separator[] = {"", " | ", " &", "; ", " && ", " || "};
+    int i;
+
+    if(node == NULL){
+        return;
+    }
+    switch(node->type){
+    case LSH_NODE_CMD:
+        for(i = 0; node->words[i] != NULL; i++){
+            lsh_str_append(out, " ", i > 0);
+            if(i > 0 && (lsh_is_token(node->words[i - 1], "<<") || lsh_is_token(node->words[i - 1], "<<-"))){
+                lsh_str_append(out, "...", 3);      //the body of a here-document
+            }
+            else{
+                lsh_str_append(out, node->words[i], strlen(node->words[i]));
+            }
+        }
+        break;
+    case LSH_NODE_FOR:
+        lsh_str_append(out, "for ", 4);
+        lsh_str_append(out, node->name, strlen(node->name));
+        lsh_str_append(out, " in", 3);
+        for(i = 0; node->words[i] != NULL; i++){
+            lsh_str_append(out, " ", 1);
+            lsh_str_append(out, node->words[i], strlen(node->words[i]));
+        }
+        lsh_str_append(out, "; do ", 5);
+        lsh_node_text(node->right, out);
+        lsh_str_append(out, "; done", 6);
+        break;
+    case LSH_NODE_FUNC:
+        lsh_str_append(out, node->name, strlen(node->name));
+        lsh_str_append(out, "() { ", 5);
+        lsh_node_text(node->right, out);
+        lsh_str_append(out, "; }", 3);
+        break;
+    case LSH_NODE_SUBSHELL:
+        lsh_str_append(out, "(", 1);
+        lsh_node_text(node->left, out);
+        lsh_str_append(out, ")", 1);
+        break;
+    case LSH_NODE_GROUP:
+        lsh_str_append(out, "{ ", 2);
+        lsh_node_text(node->left, out);
+        lsh_str_append(out, "; }", 3);
+        break;
+    default:
+        lsh_node_text(node->left, out);
+        lsh_str_append(out, separator[node->type], strlen(separator[node->type]));
+        lsh_node_text(node->right, out);
+    }
+}
+
+/*
+the zygote. a script for lsh ("#!/bin/lsh" on its first line) would normally be run by fork() and exec(): the kernel
+loads lsh again, the dynamic loader maps and links the C library, and only then the new shell starts up. an
+interactive shell forks one copy of itself right at startup, before it has any state of its own, and keeps it
+waiting on a socket. to run a script we send it the script's arguments, our environment, the fds 0, 1 and 2 and the
+working directory, and it forks (clone() with CLONE_PARENT, so the new process is our child and not its own: waitpid(),
+process groups and job control work as if we had forked it) a copy that is already loaded and just runs lsh_main().
+"set -o zygote=0" turns it off.
+*/
+struct lsh_zygote_req{
+    int argc;       //the strings that follow are the arguments (the script first)
+    int envc;       //then the environment
+};
+
+int lsh_zygote_fd = -1;     //our end of the socket, -1 if there is no zygote
+int lsh_use_zygote = 1;
+char lsh_self[PATH_MAX];        //the lsh binary, a script whose #! names it is run by the zygote
+
+int lsh_main(char **script);
+
+void lsh_zygote_child(char *buf, int *fds){
+    struct lsh_zygote_req req;
+    char **argv, *p;
+    int i;
+
+    lsh_child_setup(0, 1);      //a group of its own in the foreground, like any command
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    for(i = 0; i < 3; i++){
+        dup2(fds[i], i);
+    }
+    if(fchdir(fds[3]) != 0){
+        perror("lsh");
+    }
+    for(i = 0; i < 4; i++){
+        close(fds[i]);
+    }
+    close(lsh_tty_fd);
+    lsh_tty_fd = -1;
+
+    memcpy(&req, buf, sizeof(req));
+    argv = malloc((req.argc + 1) * sizeof(char*));
+    if(!argv){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    p = buf + sizeof(req);
+    for(i = 0; i < req.argc; i++, p += strlen(p) + 1){
+        argv[i] = p;
+    }
+    argv[i] = NULL;
+    clearenv();
+    for(i = 0; i < req.envc; i++, p += strlen(p) + 1){
+        putenv(p);      //the buffer stays, the process ends with the script
+    }
+    exit(lsh_main(argv));
+}
+
+//the zygote's loop: one request, one new shell, its pid goes back. it ends when the shell closes the socket.
+void lsh_zygote_serve(int sock){
+    static char buf[LSH_ZYGOTE_MSG];
+    char control[CMSG_SPACE(4 * sizeof(int))];
+    struct iovec iov = {buf, sizeof(buf)};
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    int fds[4], nfds, i;
+    ssize_t n;
+    pid_t pid;
+
+    for(;;){
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if(n <= 0){
+            _exit(0);
+        }
+        nfds = 0;
+        cmsg = CMSG_FIRSTHDR(&msg);
+        if(cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS){
+            nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+        }
+        pid = -1;
+        if(nfds == 4 && (size_t)n >= sizeof(struct lsh_zygote_req) && !(msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))
+           && buf[n - 1] == '\0'){
+            pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, NULL, NULL, 0);
+            if(pid == 0){
+                close(sock);
+                lsh_zygote_child(buf, fds);
+            }
+        }
+        for(i = 0; i < nfds; i++){
+            close(fds[i]);
+        }
+        if(write(sock, &pid, sizeof(pid)) != sizeof(pid)){
+            _exit(0);
+        }
+    }
+}
+
+void lsh_zygote_start(void){
+    int sv[2];
+    ssize_t n;
+    pid_t pid;
+
+    n = readlink("/proc/self/exe", lsh_self, sizeof(lsh_self) - 1);
+    if(n <= 0 || socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0){
+        return;
+    }
+    lsh_self[n] = '\0';
+    pid = fork();
+    if(pid == 0){
+        close(sv[0]);
+        signal(SIGINT, SIG_IGN);        //it is in our process group, Ctrl-C at the prompt reaches it too
+        signal(SIGQUIT, SIG_IGN);
+        lsh_zygote_serve(sv[1]);
+    }
+    close(sv[1]);
+    if(pid < 0){
+        close(sv[0]);
+        return;
+    }
+    lsh_zygote_fd = sv[0];
+}
+
+//is the program cmd would run a script for lsh? path gets its file.
+int lsh_is_script(const char *cmd, char *path){
+    const char *dirs = getenv("PATH"), *end;
+    char head[PATH_MAX + 3], interp[PATH_MAX], *p;
+    ssize_t n;
+    int fd = -1;
+
+    if(strchr(cmd, '/') != NULL){
+        snprintf(path, PATH_MAX, "%s", cmd);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    for(; fd < 0 && dirs != NULL && *dirs != '\0'; dirs = *end ? end + 1 : end){
+        end = strchrnul(dirs, ':');
+        snprintf(path, PATH_MAX, "%.*s/%s", end > dirs ? (int)(end - dirs) : 1, end > dirs ? dirs : ".", cmd);
+        if(access(path, X_OK) == 0){
+            fd = open(path, O_RDONLY | O_CLOEXEC);
+        }
+    }
+    if(fd < 0 || access(path, X_OK) != 0){
+        if(fd >= 0){
+            close(fd);
+        }
+        return 0;
+    }
+    n = read(fd, head, sizeof(head) - 1);
+    close(fd);
+    if(n < 3 || head[0] != '#' || head[1] != '!'){
+        return 0;
+    }
+    head[n] = '\0';
+    p = head + 2 + strspn(head + 2, " \t");
+    p[strcspn(p, " \t\n")] = '\0';
+    return realpath(p, interp) != NULL && strcmp(interp, lsh_self) == 0;
+}
+
+/*
+function: lsh_zygote_spawn
+have the zygote start the script args[0] in a process of its own. returns its pid, or -1 if args[0] is no lsh
+script or the zygote can't do it (then it is forked and exec()ed as usual).
+*/
+pid_t lsh_zygote_spawn(char **args, char **assigns){
+    extern char **environ;
+    struct lsh_zygote_req req = {0, 0};
+    struct lsh_str buf = {NULL, 0, 0};
+    char path[PATH_MAX], control[CMSG_SPACE(4 * sizeof(int))];
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    int fds[4] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, -1}, i;
+    pid_t pid = -1;
+
+    if(lsh_zygote_fd < 0 || !lsh_use_zygote || !lsh_is_script(args[0], path)){
+        return -1;
+    }
+    lsh_str_append(&buf, (char*)&req, sizeof(req));
+    lsh_str_append(&buf, path, strlen(path) + 1);
+    for(req.argc = 1; args[req.argc] != NULL; req.argc++){
+        lsh_str_append(&buf, args[req.argc], strlen(args[req.argc]) + 1);
+    }
+    for(i = 0; environ[i] != NULL; i++, req.envc++){
+        lsh_str_append(&buf, environ[i], strlen(environ[i]) + 1);
+    }
+    for(i = 0; assigns != NULL && assigns[i] != NULL; i++, req.envc++){      //putenv()ed after, so they win
+        lsh_str_append(&buf, assigns[i], strlen(assigns[i]) + 1);
+    }
+    memcpy(buf.data, &req, sizeof(req));
+
+    fds[3] = open(".", O_PATH | O_CLOEXEC);
+    if(fds[3] >= 0){
+        iov.iov_base = buf.data;
+        iov.iov_len = buf.len;
+        memset(&msg, 0, sizeof(msg));
+        memset(control, 0, sizeof(control));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+        fflush(stdout);
+        if(sendmsg(lsh_zygote_fd, &msg, MSG_NOSIGNAL) < 0){
+            if(errno != EMSGSIZE){      //a huge environment is just too big for it, anything else means it is gone
+                close(lsh_zygote_fd);
+                lsh_zygote_fd = -1;
+            }
+        }
+        else if(read(lsh_zygote_fd, &pid, sizeof(pid)) != sizeof(pid)){
+            close(lsh_zygote_fd);
+            lsh_zygote_fd = -1;
+            pid = -1;
+        }
+        close(fds[3]);
+    }
+    free(buf.data);
+    return pid;
+}
+
+//assigns are the "NAME=value" words written in front of the command, they only go into the child's environment.
+int lsh_launch(char** args, char** assigns){
+    //pid_t data type stands for process identification and it is used to represent process ids
+    pid_t pid;
+    struct lsh_job *job = NULL;
+    struct lsh_str text = {NULL, 0, 0};
+    int i, err;
+
+    lsh_rc_impure();
+    if(!lsh_exec_direct){
+        for(i = 0; args[i] != NULL; i++){
+            lsh_str_append(&text, " ", i > 0);
+            lsh_str_append(&text, args[i], strlen(args[i]));
+        }
+        job = lsh_new_job(text.data, 0);        //before the fork, the child needs its cgroup
+        free(text.data);
+    }
+    if(lsh_exec_direct){
+        pid = 0;        //we are the child of a pipeline or a background job already, no need for another fork
+    }
+    else if(!lsh_cmd_limited && !lsh_cmd_placed && (pid = lsh_zygote_spawn(args, assigns)) > 0){
+        //a script, the zygote started it for us
+    }
+    else{
+        fflush(stdout);     //or the child would print what is still buffered a second time
+        pid = fork();
+    }
+    if(pid == 0){
+        //children
+        if(!lsh_exec_direct){
+            lsh_child_setup(0, 1);
+            lsh_cgroup_enter(job, 0);
+        }
+        lsh_apply_cmd_limits();
+        lsh_place(&lsh_cmd_place);
+        for(; assigns != NULL && *assigns != NULL; assigns++){
+            putenv(*assigns);
+        }
+        execvp(args[0], args);      //if the exec system call returns, we know there was an error
+        err = errno;
+        perror("lsh");      //we use perror to print the system's error message, along with our program name
+        //then, we exit so the shell can keep running. not exit(), flushing stdin would move the script's offset.
+        //127 if there is no such program and 126 if it can't be run, like in other shells, so memo can tell.
+        _exit(err == ENOENT ? 127 : 126);
+    }
+    else if (pid < 0)
+    {
+        //error forking
+        perror("lsh");  
+        lsh_free_job(job);
+        lsh_last_status = 1;
+    }
+    else{           //fork() execute successfully
+        //parent process
+        if(lsh_job_control){
+            setpgid(pid, pid);      //the child does it too, whoever comes first wins the race
+        }
+        lsh_job_add_pid(job, pid);
+        lsh_foreground_job(job, 0);     //wait for it, unless it is stopped
+    }
+    return 1;
+}
+
+//"jobs" lists the jobs, the ones that finished are listed one last time and dropped.
+int lsh_jobs_builtin(char** args){
+    struct lsh_job *job, *next;
+    pid_t pid;
+    int status;
+
+    while((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0){
+        lsh_mark_process(pid, status);
+    }
+    for(job = lsh_jobs; job != NULL; job = next){
+        next = job->next;
+        lsh_print_job(job, stdout);
+        if(lsh_job_state(job) == LSH_PROC_DONE){
+            lsh_free_job(job);
+        }
+    }
+    return 1;
+}
+
+struct lsh_job *lsh_job_arg(char** args){
+    struct lsh_job *job = lsh_find_job(args[1]);
+
+    if(job == NULL){
+        fprintf(stderr, "lsh: %s: %s: no such job\n", args[0], args[1] ? args[1] : "current");
+        lsh_last_status = 1;
+    }
+    return job;
+}
+
+//"fg %n" brings a job to the foreground and continues it if it was stopped.
+int lsh_fg(char** args){
+    struct lsh_job *job = lsh_job_arg(args);
+
+    if(job != NULL){
+        printf("%s\n", job->text);
+        fflush(stdout);
+        lsh_foreground_job(job, 1);
+    }
+    return 1;
+}
+
+//"bg %n" lets a stopped job go on running in the background.
+int lsh_bg(char** args){
+    struct lsh_job *job = lsh_job_arg(args);
+    int i;
+
+    if(job != NULL){
+        job->background = 1;
+        for(i = 0; i < job->npids; i++){
+            if(job->states[i] == LSH_PROC_STOPPED){
+                job->states[i] = LSH_PROC_RUNNING;
+            }
+        }
+        lsh_signal_job(job, SIGCONT);
+        printf("[%d] %s &\n", job->id, job->text);
+    }
+    return 1;
+}
+
+char *lsh_signal_names[] = {
+    NULL, "HUP", "INT", "QUIT", "ILL", "TRAP", "ABRT", "BUS", "FPE", "KILL", "USR1", "SEGV", "USR2", "PIPE", "ALRM",
+    "TERM", "STKFLT", "CHLD", "CONT", "STOP", "TSTP", "TTIN", "TTOU", "URG", "XCPU", "XFSZ", "VTALRM", "PROF", "WINCH",
+    "IO", "PWR", "SYS"
+};
+
+//a signal by number or by name, with or without "SIG" in front. -1 if there is no such signal.
+int lsh_signal_number(const char *name){
+    char *end;
+    long n;
+    int i;
+
+    n = strtol(name, &end, 10);
+    if(end != name && *end == '\0'){
+        return n > 0 && n < NSIG ? (int)n : -1;
+    }
+    if(strncasecmp(name, "SIG", 3) == 0){
+        name += 3;
+    }
+    for(i = 1; i < (int)(sizeof(lsh_signal_names) / sizeof(char*)); i++){
+        if(strcasecmp(name, lsh_signal_names[i]) == 0){
+            return i;
+        }
+    }
+    return -1;
+}
+
+//"kill [-SIG] %n|pid ..." sends a signal (TERM if none is given) to jobs and processes.
+int lsh_kill(char** args){
+    struct lsh_job *job;
+    int sig = SIGTERM, i = 1;
+
+    if(args[1] != NULL && args[1][0] == '-' && args[1][1] != '\0'){
+        if(strcmp(args[1], "-s") == 0 && args[2] != NULL){
+            i++;
+        }
+        if((sig = lsh_signal_number(args[i] + (i == 1))) < 0){
+            fprintf(stderr, "lsh: kill: %s: invalid signal\n", args[i] + (i == 1));
+            lsh_last_status = 1;
+            return 1;
+        }
+        i++;
+    }
+    if(args[i] == NULL){
+        fprintf(stderr, "lsh: kill: usage: kill [-SIG] %%job|pid ...\n");
+        lsh_last_status = 2;
+        return 1;
+    }
+    for(; args[i] != NULL; i++){
+        if(args[i][0] == '%'){
+            if((job = lsh_find_job(args[i])) == NULL){
+                fprintf(stderr, "lsh: kill: %s: no such job\n", args[i]);
+                lsh_last_status = 1;
+                continue;
+            }
+            if(lsh_signal_job(job, sig) < 0){
+                perror("lsh: kill");
+                lsh_last_status = 1;
+            }
+            if(sig == SIGKILL || sig == SIGTERM){
+                lsh_signal_job(job, SIGCONT);       //a stopped job only sees the signal once it runs again
+            }
+        }
+        else if(kill(atoi(args[i]), sig) < 0){
+            perror("lsh: kill");
+            lsh_last_status = 1;
+        }
+    }
+    return 1;
+}
+
+/*
+cgroups. with "set -o cgroups=1" every job gets a cgroup v2 group of its own, job<shell pid>.<n>, in a delegated
+directory (the group the shell was started in, or the one given with "cgroup -d"), and the limits set with the cgroup
+builtin are written into its cpu.max, memory.max and io.max. a child moves itself into the group between fork() and
+exec(), and the shell moves it too, like with setpgid(), which also catches the scripts the zygote starts. whatever a
+job starts stays in its group. when the job is done we report its cpu.stat and memory.peak and remove the group.
+
+cgroup v2 only hands controllers down from a group that has no processes of its own, so when the shell sits in the
+directory itself (and it is not the root) it first moves into a "shell" group next to its jobs.
+*/
+#define LSH_CGROUP_LIMITS 3
+
+int lsh_use_cgroups = 0;
+char *lsh_cgroup_dir = NULL;        //"cgroup -d", NULL for the shell's own group
+char *lsh_cgroup_limit[LSH_CGROUP_LIMITS];      //NULL leaves the file as it is
+char *lsh_cgroup_file[LSH_CGROUP_LIMITS] = {"cpu.max", "memory.max", "io.max"};
+char lsh_cgroup_flag[LSH_CGROUP_LIMITS] = {'c', 'm', 'i'};
+char *lsh_cgroup_path = NULL;       //the directory once it is set up, and open in lsh_cgroup_root
+char *lsh_cgroup_home = NULL;       //the shell's own group, found once: after the move /proc/self/cgroup says .../shell
+int lsh_cgroup_nested = 0;      //home is not the root, the shell moves into home/shell
+int lsh_cgroup_root = -1;
+unsigned lsh_cgroup_seq = 0;
+
+char *lsh_strdup(const char *s);
+
+int lsh_cgroup_write(int dir, const char *file, const char *value){
+    int fd = openat(dir, file, O_WRONLY | O_CLOEXEC), ret;
+
+    if(fd < 0){
+        return -1;
+    }
+    ret = write(fd, value, strlen(value)) < 0 ? -1 : 0;
+    close(fd);
+    return ret;
+}
+
+ssize_t lsh_cgroup_read(int dir, const char *file, char *buf, size_t size){
+    int fd = openat(dir, file, O_RDONLY | O_CLOEXEC);
+    ssize_t n;
+
+    if(fd < 0){
+        return -1;
+    }
+    n = read(fd, buf, size - 1);
+    close(fd);
+    buf[n > 0 ? n : 0] = '\0';
+    return n;
+}
+
+//the directory the jobs' groups go into: where cgroup2 is mounted (a hybrid system has it under .../unified) plus
+//the group the shell is in, from the "0::" line of /proc/self/cgroup.
+int lsh_cgroup_setup(void){
+    char mount[PATH_MAX] = "/sys/fs/cgroup", dir[PATH_MAX], type[64], *line = NULL, *own = NULL;
+    size_t cap = 0;
+    FILE *f;
+
+    if(lsh_cgroup_root >= 0){
+        return 0;
+    }
+    if(lsh_cgroup_dir == NULL && lsh_cgroup_home == NULL){
+        if((f = fopen("/proc/self/mounts", "re")) != NULL){
+            while(fscanf(f, "%*s %4095s %63s %*[^\n]", dir, type) == 2){
+                if(strcmp(type, "cgroup2") == 0){
+                    strcpy(mount, dir);
+                    break;
+                }
+            }
+            fclose(f);
+        }
+        if((f = fopen("/proc/self/cgroup", "re")) != NULL){
+            while(own == NULL && getline(&line, &cap, f) > 0){
+                if(strncmp(line, "0::", 3) == 0){
+                    own = line + 3;
+                    own[strcspn(own, "\n")] = '\0';
+                }
+            }
+            fclose(f);
+        }
+        if(own == NULL){
+            fprintf(stderr, "lsh: cgroup: the shell is in no cgroup v2 group, use cgroup -d\n");
+            free(line);
+            return -1;
+        }
+        snprintf(dir, sizeof(dir), "%s%s", mount, strcmp(own, "/") == 0 ? "" : own);
+        lsh_cgroup_home = lsh_strdup(dir);
+        lsh_cgroup_nested = strcmp(own, "/") != 0;
+    }
+    snprintf(dir, sizeof(dir), "%s", lsh_cgroup_dir != NULL ? lsh_cgroup_dir : lsh_cgroup_home);
+
+    lsh_cgroup_root = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(lsh_cgroup_root >= 0 && lsh_cgroup_dir == NULL && lsh_cgroup_nested
+       && ((mkdirat(lsh_cgroup_root, "shell", 0755) < 0 && errno != EEXIST)
+           || lsh_cgroup_write(lsh_cgroup_root, "shell/cgroup.procs", "0") < 0)){
+        close(lsh_cgroup_root);
+        lsh_cgroup_root = -1;
+    }
+    free(line);
+    if(lsh_cgroup_root < 0){
+        fprintf(stderr, "lsh: cgroup: %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    lsh_cgroup_path = lsh_strdup(dir);
+    return 0;
+}
+
+//a new job gets its group, with the limits in it. if that fails the option is turned off, not tried for every job.
+void lsh_cgroup_attach(struct lsh_job *job){
+    char name[PATH_MAX + 64], controller[16];
+    int i;
+
+    job->cgroup = -1;
+    if(!lsh_use_cgroups){
+        return;
+    }
+    if(lsh_cgroup_setup() < 0){
+        lsh_use_cgroups = 0;
+        return;
+    }
+    for(i = 0; i < LSH_CGROUP_LIMITS; i++){
+        if(lsh_cgroup_limit[i] != NULL){
+            //"+memory" for memory.max. it may be on already, or not available, then writing the limit says so
+            snprintf(controller, sizeof(controller), "+%.*s", (int)strcspn(lsh_cgroup_file[i], "."), lsh_cgroup_file[i]);
+            lsh_cgroup_write(lsh_cgroup_root, "cgroup.subtree_control", controller);
+        }
+    }
+    snprintf(name, sizeof(name), "%s/job%d.%u", lsh_cgroup_path, (int)getpid(), lsh_cgroup_seq++);
+    if(mkdir(name, 0755) < 0 || (job->cgroup = open(name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0){
+        fprintf(stderr, "lsh: cgroup: %s: %s\n", name, strerror(errno));
+        rmdir(name);
+        lsh_use_cgroups = 0;
+        return;
+    }
+    job->cgroup_path = lsh_strdup(name);
+    for(i = 0; i < LSH_CGROUP_LIMITS; i++){
+        if(lsh_cgroup_limit[i] != NULL && lsh_cgroup_write(job->cgroup, lsh_cgroup_file[i], lsh_cgroup_limit[i]) < 0){
+            fprintf(stderr, "lsh: cgroup: %s: %s\n", lsh_cgroup_file[i], strerror(errno));
+        }
+    }
+}
+
+//put pid into the job's group, 0 is the calling process. a child calls it after fork(), so nothing but system calls.
+void lsh_cgroup_enter(struct lsh_job *job, pid_t pid){
+    char number[24];
+
+    if(job->cgroup < 0){
+        return;
+    }
+    if(pid == 0){
+        lsh_cgroup_write(job->cgroup, "cgroup.procs", "0");
+        return;
+    }
+    snprintf(number, sizeof(number), "%d", (int)pid);
+    lsh_cgroup_write(job->cgroup, "cgroup.procs", number);
+}
+
+//what a finished job used: "make -j8: cpu 41.20s (user 38.02s, sys 3.18s), memory peak 1.2G"
+void lsh_cgroup_report(struct lsh_job *job){
+    char buf[1024], *p;
+    long long usage = 0, user = 0, sys = 0;
+    double peak;
+    const char *unit = "KMGT";
+
+    if(lsh_cgroup_read(job->cgroup, "cpu.stat", buf, sizeof(buf)) < 0){
+        return;
+    }
+    for(p = buf; p != NULL && *p != '\0'; p = strchr(p, '\n') ? strchr(p, '\n') + 1 : NULL){
+        sscanf(p, "usage_usec %lld", &usage);
+        sscanf(p, "user_usec %lld", &user);
+        sscanf(p, "system_usec %lld", &sys);
+    }
+    fprintf(stderr, "%s: cpu %.2fs (user %.2fs, sys %.2fs)", job->text, usage / 1e6, user / 1e6, sys / 1e6);
+    if(lsh_cgroup_read(job->cgroup, "memory.peak", buf, sizeof(buf)) > 0){     //Linux 5.19, with the memory controller
+        for(peak = atof(buf) / 1024; peak >= 1024 && unit[1] != '\0'; peak /= 1024){
+            unit++;
+        }
+        fprintf(stderr, ", memory peak %.1f%c", peak, *unit);
+    }
+    fprintf(stderr, "\n");
+}
+
+void lsh_cgroup_release(struct lsh_job *job){
+    if(job->cgroup < 0){
+        return;
+    }
+    if(job->npids > 0 && lsh_job_state(job) == LSH_PROC_DONE){
+        lsh_cgroup_report(job);
+    }
+    close(job->cgroup);
+    rmdir(job->cgroup_path);        //busy if something the job started still runs, it is left to that then
+    free(job->cgroup_path);
+}
+
+//cgroup [-c cpu.max] [-m memory.max] [-i io.max] [-d dir]: the limits the jobs get with "set -o cgroups=1", in the
+//format of those files ("50000 100000", "512M", "8:0 wbps=1048576"). "" takes one back. without arguments it lists them.
+int lsh_cgroup(char** args){
+    int i, k;
+
+    if(args[1] == NULL){
+        if(lsh_cgroup_dir != NULL){
+            fprintf(LSH_STDOUT, "dir=%s\n", lsh_cgroup_dir);
+        }
+        for(k = 0; k < LSH_CGROUP_LIMITS; k++){
+            if(lsh_cgroup_limit[k] != NULL){
+                fprintf(LSH_STDOUT, "%s=%s\n", lsh_cgroup_file[k], lsh_cgroup_limit[k]);
+            }
+        }
+        return 1;
+    }
+    for(i = 1; args[i] != NULL; i += 2){
+        for(k = 0; k < LSH_CGROUP_LIMITS && !(args[i][0] == '-' && args[i][1] == lsh_cgroup_flag[k]); k++){
+        }
+        if(args[i][0] != '-' || args[i][1] == '\0' || args[i][2] != '\0' || args[i + 1] == NULL
+           || (k == LSH_CGROUP_LIMITS && args[i][1] != 'd')){
+            fprintf(stderr, "lsh: usage: cgroup [-c cpu.max] [-m memory.max] [-i io.max] [-d dir]\n");
+            lsh_last_status = 2;
+            return 1;
+        }
+        if(k == LSH_CGROUP_LIMITS){
+            free(lsh_cgroup_dir);
+            lsh_cgroup_dir = args[i + 1][0] != '\0' ? lsh_strdup(args[i + 1]) : NULL;
+            if(lsh_cgroup_root >= 0){
+                close(lsh_cgroup_root);     //set up again for the next job, the jobs that run keep their paths
+                lsh_cgroup_root = -1;
+            }
+            free(lsh_cgroup_path);
+            lsh_cgroup_path = NULL;
+            continue;
+        }
+        free(lsh_cgroup_limit[k]);
+        lsh_cgroup_limit[k] = args[i + 1][0] != '\0' ? lsh_strdup(args[i + 1]) : NULL;
+    }
+    return 1;
+}
+
+/*
+ulimit: the resource limits of the shell, which every command it starts inherits, as in other shells: "ulimit -n 4096",
+"ulimit -a". with a command after them, "ulimit -v 2000000 -n 64 make", the limits are for that command only: the
+child sets them between fork() and exec() and the shell keeps its own. sizes are in kbytes, -t is in seconds, -n and
+-u are counts, "unlimited", "hard" and "soft" work for all of them. -H and -S pick one of the two limits, setting
+without them sets both.
+the command has to be a program, a function or an alias can't get limits of its own this way and is refused. pin and
+memo can come in between, "ulimit -n 64 pin -n 1 make", see lsh_launch_command().
+*/
+struct lsh_ulimit{
+    char flag;
+    int resource;
+    rlim_t unit;
+    char *name;
+};
+
+struct lsh_ulimit lsh_ulimits[] = {
+    {'c', RLIMIT_CORE, 1024, "core file size (kbytes)"},
+    {'d', RLIMIT_DATA, 1024, "data seg size (kbytes)"},
+    {'f', RLIMIT_FSIZE, 1024, "file size (kbytes)"},
+    {'l', RLIMIT_MEMLOCK, 1024, "max locked memory (kbytes)"},
+    {'m', RLIMIT_RSS, 1024, "max memory size (kbytes)"},
+    {'n', RLIMIT_NOFILE, 1, "open files"},
+    {'s', RLIMIT_STACK, 1024, "stack size (kbytes)"},
+    {'t', RLIMIT_CPU, 1, "cpu time (seconds)"},
+    {'u', RLIMIT_NPROC, 1, "max user processes"},
+    {'v', RLIMIT_AS, 1024, "virtual memory (kbytes)"}
+};
+
+#define LSH_NUM_ULIMITS (int)(sizeof(lsh_ulimits) / sizeof(lsh_ulimits[0]))
+
+struct rlimit lsh_cmd_limit[LSH_NUM_ULIMITS];       //what the next command gets, for the limits whose bit is set
+int lsh_cmd_limited = 0;
+
+//in the child of "ulimit ... command". a limit it can't have means it doesn't run, not that it runs without it.
+void lsh_apply_cmd_limits(void){
+    int k;
+
+    for(k = 0; k < LSH_NUM_ULIMITS; k++){
+        if((lsh_cmd_limited & (1 << k)) && setrlimit(lsh_ulimits[k].resource, &lsh_cmd_limit[k]) < 0){
+            fprintf(stderr, "lsh: ulimit: %s: %s\n", lsh_ulimits[k].name, strerror(errno));
+            _exit(EXIT_FAILURE);
+        }
+    }
+}
+
+int lsh_ulimit_find(char flag){
+    int k;
+
+    for(k = 0; k < LSH_NUM_ULIMITS; k++){
+        if(lsh_ulimits[k].flag == flag){
+            return k;
+        }
+    }
+    return -1;
+}
+
+//a limit as it is written, into what setrlimit() takes. -1 if it is not one.
+int lsh_ulimit_value(const char *s, int k, rlim_t *value){
+    struct rlimit lim;
+    unsigned long long n;
+    char *end;
+
+    if(strcmp(s, "unlimited") == 0){
+        *value = RLIM_INFINITY;
+        return 0;
+    }
+    if(strcmp(s, "hard") == 0 || strcmp(s, "soft") == 0){
+        getrlimit(lsh_ulimits[k].resource, &lim);
+        *value = s[0] == 'h' ? lim.rlim_max : lim.rlim_cur;
+        return 0;
+    }
+    if(s[0] < '0' || s[0] > '9'){
+        return -1;
+    }
+    errno = 0;
+    n = strtoull(s, &end, 10);
+    if(*end != '\0' || errno != 0 || n >= RLIM_INFINITY / lsh_ulimits[k].unit){
+        return -1;
+    }
+    *value = n * lsh_ulimits[k].unit;
+    return 0;
+}
+
+void lsh_ulimit_print(int k, int hard, int named){
+    struct rlimit lim;
+    rlim_t value;
+
+    getrlimit(lsh_ulimits[k].resource, &lim);
+    value = hard ? lim.rlim_max : lim.rlim_cur;
+    if(named){
+        fprintf(LSH_STDOUT, "%-28s (-%c) ", lsh_ulimits[k].name, lsh_ulimits[k].flag);
+    }
+    if(value == RLIM_INFINITY){
+        fprintf(LSH_STDOUT, "unlimited\n");
+    }
+    else{
+        fprintf(LSH_STDOUT, "%llu\n", (unsigned long long)(value / lsh_ulimits[k].unit));
+    }
+}
+
+struct lsh_func *lsh_findfunc(const char *name);
+struct lsh_alias *lsh_findalias(const char *name);
+int lsh_pin(char** args);
+int lsh_memo(char** args);
+
+/*
+function: lsh_launch_command
+run the command of "ulimit ... command", "pin ... command" or "memo ... command". they set up the child in between
+fork() and exec() of lsh_launch(), so the command is a program: a function or an alias is refused rather than passed
+by. pin and memo can follow, each sets up its part and hands the rest on. ulimit can't, without a command it would
+set the shell's own limits, it has to come first. "FOO=1 pin -c 0 make" puts FOO into make's environment.
+*/
+int lsh_launch_command(const char *by, char **args){
+    if(lsh_findfunc(args[0]) != NULL || lsh_findalias(args[0]) != NULL){
+        fprintf(stderr, "lsh: %s: %s: is %s, %s only runs programs\n", by, args[0],
+                lsh_findfunc(args[0]) != NULL ? "a function" : "an alias", by);
+        lsh_last_status = 2;
+        return 1;
+    }
+    if(strcmp(args[0], "pin") == 0){
+        return lsh_pin(args);
+    }
+    if(strcmp(args[0], "memo") == 0){
+        return lsh_memo(args);
+    }
+    return lsh_launch(args, lsh_cmd_assigns);
+}
+
+//ulimit [-HSa] [-cdflmnstuv [limit]]... [command [args...]]
+int lsh_ulimit(char** args){
+    struct rlimit lim;
+    rlim_t value;
+    int ops[LSH_NUM_ULIMITS * 2], i, j, n = 0, hard = 0, soft = 0, all = 0, k;
+    char *values[LSH_NUM_ULIMITS * 2], *p;
+
+    for(i = 1; args[i] != NULL && args[i][0] == '-' && args[i][1] != '\0'; i++){
+        if(strcmp(args[i], "--") == 0){
+            i++;
+            break;
+        }
+        for(p = args[i] + 1; *p != '\0'; p++){
+            if(*p == 'H' || *p == 'S' || *p == 'a'){
+                hard |= *p == 'H';
+                soft |= *p == 'S';
+                all |= *p == 'a';
+            }
+            else if((k = lsh_ulimit_find(*p)) < 0 || n == LSH_NUM_ULIMITS * 2){
+                fprintf(stderr, "lsh: ulimit: -%c: invalid option\n", *p);
+                fprintf(stderr, "lsh: usage: ulimit [-HSa] [-cdflmnstuv [limit]]... [command [args...]]\n");
+                lsh_last_status = 2;
+                return 1;
+            }
+            else{
+                ops[n] = k;
+                values[n++] = NULL;
+            }
+        }
+        //the value of the last one, if the next word is one: "ulimit -n 64 make"
+        if(n > 0 && values[n - 1] == NULL && p[-1] == lsh_ulimits[ops[n - 1]].flag && args[i + 1] != NULL
+           && lsh_ulimit_value(args[i + 1], ops[n - 1], &value) == 0){
+            values[n - 1] = args[++i];
+        }
+    }
+    if(n == 0 && !all && args[i] != NULL && args[i + 1] == NULL && lsh_ulimit_value(args[i], 2, &value) == 0){
+        ops[n] = 2;     //"ulimit 1000" is -f
+        values[n++] = args[i++];
+    }
+
+    for(j = 0; j < n; j++){
+        k = ops[j];
+        if(values[j] == NULL){
+            if(args[i] != NULL){
+                fprintf(stderr, "lsh: ulimit: %s: invalid limit\n", args[i]);     //or a command, but then the limit needs a value
+                lsh_last_status = 2;
+                return 1;
+            }
+            lsh_ulimit_print(k, hard && !soft, n > 1 || all);
+            continue;
+        }
+        getrlimit(lsh_ulimits[k].resource, &lim);
+        lsh_ulimit_value(values[j], k, &value);
+        if(hard || !soft){
+            lim.rlim_max = value;
+        }
+        if(soft || !hard){
+            lim.rlim_cur = value;
+        }
+        if(args[i] != NULL){
+            lsh_cmd_limit[k] = lim;     //for the command only
+            lsh_cmd_limited |= 1 << k;
+        }
+        else if(setrlimit(lsh_ulimits[k].resource, &lim) < 0){
+            fprintf(stderr, "lsh: ulimit: %s: %s\n", lsh_ulimits[k].name, strerror(errno));
+            lsh_last_status = 1;
+        }
+    }
+    if(args[i] != NULL){
+        lsh_launch_command("ulimit", args + i);
+        lsh_cmd_limited = 0;
+        return 1;
+    }
+    for(k = 0; all && k < LSH_NUM_ULIMITS; k++){
+        lsh_ulimit_print(k, hard && !soft, 1);
+    }
+    if(n == 0 && !all){
+        lsh_ulimit_print(2, hard && !soft, 0);       //like in other shells, no option is -f
+    }
+    return 1;
+}
+
+/*
+placement. on a machine with several NUMA nodes a command lands on any core, and its memory wherever that core was
+when it asked for it. "pin -c 0-7 command" and "pin -n 1 command" run the command on those CPUs, or on the CPUs of
+node 1 with its memory preferably there too (not bound, a full node falls back to the others instead of the OOM
+killer). the child calls sched_setaffinity() and set_mempolicy() between fork() and exec(), the shell stays where it is.
+"set -o spread=1" does the same for fan-out: every background job goes to the next node in turn, and whatever it
+starts stays there. the nodes are read once from /sys/devices/system/node.
+*/
+struct lsh_placement{
+    cpu_set_t cpus;
+    int has_cpus;
+    int node;       //-1 for no memory policy
+};
+
+struct lsh_placement lsh_cmd_place = {.node = -1};      //for "pin ... command"
+int lsh_cmd_placed = 0;
+int lsh_spread = 0;
+int lsh_spread_next = 0;
+cpu_set_t *lsh_node_cpus = NULL;        //indexed by node number, a node without CPUs has an empty set
+int lsh_num_nodes = -1;
+
+//"0-3,8,10-11" into a CPU set, -1 if it isn't one.
+int lsh_parse_cpulist(const char *list, cpu_set_t *cpus){
+    unsigned long first, last;
+    char *end;
+
+    CPU_ZERO(cpus);
+    while(*list != '\0' && *list != '\n'){
+        if(*list < '0' || *list > '9'){
+            return -1;
+        }
+        first = last = strtoul(list, &end, 10);
+        if(*end == '-'){
+            if(end[1] < '0' || end[1] > '9'){
+                return -1;
+            }
+            last = strtoul(end + 1, &end, 10);
+        }
+        if(last < first || last >= CPU_SETSIZE){
+            return -1;
+        }
+        for(; first <= last; first++){
+            CPU_SET(first, cpus);
+        }
+        if(*end == ','){
+            end++;
+        }
+        else if(*end != '\0' && *end != '\n'){
+            return -1;
+        }
+        list = end;
+    }
+    return 0;
+}
+
+void lsh_print_cpulist(cpu_set_t *cpus){
+    int cpu, last, sep = 0;
+
+    for(cpu = 0; cpu < CPU_SETSIZE; cpu++){
+        if(!CPU_ISSET(cpu, cpus)){
+            continue;
+        }
+        for(last = cpu; last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus); last++){
+        }
+        fprintf(LSH_STDOUT, sep++ ? ",%d" : "%d", cpu);
+        if(last > cpu){
+            fprintf(LSH_STDOUT, "-%d", last);
+        }
+        cpu = last;
+    }
+    fprintf(LSH_STDOUT, "\n");
+}
+
+int lsh_numa_nodes(void){
+    char path[64], list[4096];
+    int node, fd;
+    ssize_t n;
+
+    if(lsh_num_nodes >= 0){
+        return lsh_num_nodes;
+    }
+    lsh_num_nodes = 0;
+    for(node = 0; ; node++){
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        if((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0){
+            break;      //node numbers can have holes after hotplug, we stop at the first one
+        }
+        n = read(fd, list, sizeof(list) - 1);
+        close(fd);
+        list[n > 0 ? n : 0] = '\0';
+        lsh_node_cpus = realloc(lsh_node_cpus, (node + 1) * sizeof(cpu_set_t));
+        if(!lsh_node_cpus){
+            fprintf(stderr,"lsh: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        if(lsh_parse_cpulist(list, &lsh_node_cpus[node]) < 0){
+            CPU_ZERO(&lsh_node_cpus[node]);
+        }
+        lsh_num_nodes++;
+    }
+    return lsh_num_nodes;
+}
+
+//in a child, before it runs anything. a placement that doesn't work is worth a warning, not the command.
+void lsh_place(struct lsh_placement *place){
+    unsigned long mask[16] = {0};
+
+    if(place->has_cpus && sched_setaffinity(0, sizeof(place->cpus), &place->cpus) < 0){
+        perror("lsh: sched_setaffinity");
+    }
+    if(place->node >= 0 && place->node < (int)(sizeof(mask) * 8)){
+        mask[place->node / (sizeof(long) * 8)] |= 1UL << (place->node % (sizeof(long) * 8));
+        if(syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, sizeof(mask) * 8) < 0){
+            perror("lsh: set_mempolicy");
+        }
+    }
+}
+
+//the next node for a background job with "set -o spread=1", has_cpus 0 and node -1 when there is nothing to spread over.
+void lsh_spread_job(struct lsh_placement *place){
+    place->has_cpus = 0;
+    place->node = -1;
+    if(!lsh_spread || lsh_numa_nodes() == 0){
+        return;
+    }
+    place->node = lsh_spread_next++ % lsh_num_nodes;
+    place->cpus = lsh_node_cpus[place->node];
+    place->has_cpus = CPU_COUNT(&place->cpus) > 0;      //a node with memory only
+}
+
+//pin [-c cpus] [-n node] [--] command [args...], without a command it lists the nodes and where the shell may run.
+//the command is a program, see lsh_launch_command().
+int lsh_pin(char** args){
+    cpu_set_t allowed;
+    int i, node;
+    char *end;
+
+    lsh_cmd_place.has_cpus = 0;
+    lsh_cmd_place.node = -1;
+    for(i = 1; args[i] != NULL && args[i][0] == '-' && strcmp(args[i], "--") != 0; i += 2){
+        if((strcmp(args[i], "-c") != 0 && strcmp(args[i], "-n") != 0) || args[i + 1] == NULL){
+            fprintf(stderr, "lsh: usage: pin [-c cpus] [-n node] [--] command [args...]\n");
+            lsh_last_status = 2;
+            return 1;
+        }
+        if(args[i][1] == 'c' && lsh_parse_cpulist(args[i + 1], &lsh_cmd_place.cpus) < 0){
+            fprintf(stderr, "lsh: pin: %s: invalid CPU list\n", args[i + 1]);
+            lsh_last_status = 2;
+            return 1;
+        }
+        if(args[i][1] == 'c'){
+            lsh_cmd_place.has_cpus = 1;
+            continue;
+        }
+        node = strtol(args[i + 1], &end, 10);
+        if(*end != '\0' || end == args[i + 1] || node < 0 || node >= lsh_numa_nodes()){
+            fprintf(stderr, "lsh: pin: %s: no such NUMA node\n", args[i + 1]);
+            lsh_last_status = 2;
+            return 1;
+        }
+        lsh_cmd_place.node = node;
+    }
+    if(args[i] != NULL && strcmp(args[i], "--") == 0){
+        i++;
+    }
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    if(args[i] == NULL){
+        if(i > 1){
+            fprintf(stderr, "lsh: usage: pin [-c cpus] [-n node] [--] command [args...]\n");
+            lsh_last_status = 2;
+            return 1;
+        }
+        for(node = 0; node < lsh_numa_nodes(); node++){
+            fprintf(LSH_STDOUT, "node%d ", node);
+            lsh_print_cpulist(&lsh_node_cpus[node]);
+        }
+        fprintf(LSH_STDOUT, "allowed ");
+        lsh_print_cpulist(&allowed);
+        return 1;
+    }
+    if(lsh_cmd_place.node >= 0 && !lsh_cmd_place.has_cpus){
+        lsh_cmd_place.cpus = lsh_node_cpus[lsh_cmd_place.node];
+        lsh_cmd_place.has_cpus = CPU_COUNT(&lsh_cmd_place.cpus) > 0;
+    }
+    if(lsh_cmd_place.has_cpus){
+        CPU_AND(&lsh_cmd_place.cpus, &lsh_cmd_place.cpus, &allowed);
+        if(CPU_COUNT(&lsh_cmd_place.cpus) == 0){
+            fprintf(stderr, "lsh: pin: none of these CPUs is available\n");
+            lsh_last_status = 1;
+            return 1;
+        }
+    }
+    lsh_cmd_placed = 1;
+    lsh_launch_command("pin", args + i);
+    lsh_cmd_placed = 0;
+    lsh_cmd_place.has_cpus = 0;
+    lsh_cmd_place.node = -1;
+    return 1;
+}
+
+/*
+signals. the shell must survive a Ctrl-C or a Ctrl-\ meant for the command it runs, so instead of letting them kill us
+we block SIGINT and SIGQUIT and read them from a signalfd: they become ordinary input that the main loop looks at
+between commands and while it waits for a line. signals that the user traps with "trap 'commands' SIG" are added to
+the same set, and their commands run at the same safe points, never in the middle of something else.
+
+"trap" also knows two pseudo signals, EXIT runs when the shell exits and ERR after every command that fails.
+the children get the default dispositions back before they run anything.
+*/
+#define LSH_TRAP_ERR NSIG       //where ERR lives in lsh_traps, EXIT is number 0
+
+char *lsh_traps[NSIG + 1];      //NULL is the default, "" ignores the signal
+int lsh_sigfd = -1;
+sigset_t lsh_sigmask;       //the signals we read from lsh_sigfd
+sigset_t lsh_orig_mask;     //the mask we were started with, the children get it back
+int lsh_in_trap = 0;
+int lsh_in_condition = 0;       //inside the left side of && or ||, where a failure is not an error
+
+int lsh_run(char *text);
+
+void lsh_update_sigfd(void){
+    sigset_t mask = lsh_orig_mask;
+    int sig;
+
+    for(sig = 1; sig < NSIG; sig++){
+        if(sigismember(&lsh_sigmask, sig) == 1){
+            sigaddset(&mask, sig);
+        }
+    }
+    sigprocmask(SIG_SETMASK, &mask, NULL);      //a signal has to be blocked, or it is acted upon before signalfd sees it
+    lsh_sigfd = signalfd(lsh_sigfd, &lsh_sigmask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if(lsh_sigfd < 0){
+        perror("lsh: signalfd");
+    }
+}
+
+void lsh_init_signals(void){
+    sigprocmask(SIG_SETMASK, NULL, &lsh_orig_mask);
+    sigemptyset(&lsh_sigmask);
+    sigaddset(&lsh_sigmask, SIGINT);
+    sigaddset(&lsh_sigmask, SIGQUIT);
+    lsh_update_sigfd();
+    if(lsh_job_control){
+        setvbuf(stdin, NULL, _IONBF, 0);        //so that poll() on fd 0 tells the truth about what getline() has left
+    }
+}
+
+//called in every forked child: traps are not inherited, ignored signals stay ignored.
+void lsh_reset_signals(void){
+    int sig;
+
+    for(sig = 1; sig < NSIG; sig++){
+        if(sigismember(&lsh_sigmask, sig) == 1){
+            signal(sig, lsh_traps[sig] != NULL && lsh_traps[sig][0] == '\0' ? SIG_IGN : SIG_DFL);
+        }
+        if(lsh_traps[sig] != NULL && lsh_traps[sig][0] != '\0'){
+            free(lsh_traps[sig]);
+            lsh_traps[sig] = NULL;
+        }
+    }
+    free(lsh_traps[0]);
+    free(lsh_traps[LSH_TRAP_ERR]);
+    lsh_traps[0] = lsh_traps[LSH_TRAP_ERR] = NULL;
+    sigprocmask(SIG_SETMASK, &lsh_orig_mask, NULL);
+    if(lsh_sigfd >= 0){
+        close(lsh_sigfd);
+        lsh_sigfd = -1;
+    }
+}
+
+//run the commands of a trap. $? is the same afterwards, an "exit" in them ends the shell.
+void lsh_run_trap(const char *action){
+    struct lsh_arena_pos pos;
+    int saved_status = lsh_last_status, status;
+
+    if(action == NULL || action[0] == '\0' || lsh_in_trap){
+        return;
+    }
+    lsh_in_trap = 1;
+    pos = lsh_arena_mark();
+    status = lsh_run(lsh_arena_strndup(action, strlen(action)));        //a copy, the trap may replace itself
+    lsh_arena_release(pos);
+    lsh_in_trap = 0;
+    if(!status){
+        lsh_run_exit_trap();
+        exit(lsh_last_status);
+    }
+    lsh_last_status = saved_status;
+}
+
+void lsh_run_exit_trap(void){
+    char *action = lsh_traps[0];
+
+    lsh_traps[0] = NULL;        //only once, even if it runs "exit" itself
+    lsh_run_trap(action);
+    free(action);
+}
+
+//a script that gets a Ctrl-C nobody trapped dies of it, so that whoever runs the script sees it too.
+void lsh_die(int sig){
+    sigset_t mask;
+
+    lsh_run_exit_trap();
+    fflush(NULL);
+    signal(sig, SIG_DFL);
+    sigemptyset(&mask);
+    sigaddset(&mask, sig);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+    raise(sig);
+    exit(128 + sig);
+}
+
+/*
+function: lsh_handle_signals
+read the signals that arrived since the last time and act on them: run their traps, or for an untrapped Ctrl-C, stop
+the command line (interactive) or the whole shell (a script). it never blocks.
+*/
+void lsh_handle_signals(void){
+    struct signalfd_siginfo info;
+    int sig;
+
+    while(lsh_sigfd >= 0 && read(lsh_sigfd, &info, sizeof(info)) == sizeof(info)){
+        sig = info.ssi_signo;
+        if(lsh_traps[sig] != NULL){
+            lsh_run_trap(lsh_traps[sig]);
+        }
+        else if(!lsh_job_control){
+            lsh_die(sig);
+        }
+        if(sig == SIGINT && lsh_job_control){
+            lsh_interrupted = 1;        //trapped or not, at the prompt it throws the line away
+        }
+    }
+}
+
+//what happens after every command: ERR if it failed, then the signals that came in while it ran.
+void lsh_after_command(void){
+    if(lsh_last_status != 0 && lsh_in_condition == 0){
+        lsh_run_trap(lsh_traps[LSH_TRAP_ERR]);
+    }
+    lsh_handle_signals();
+}
+
+int lsh_prompt_fd = -1;     //readable when a slow part of the prompt is ready, see lsh_render_prompt()
+
+/*
+wait until there is input on stdin, handling signals meanwhile. it returns 0 if the user pressed Ctrl-C, and 2 if
+the prompt should be drawn again.
+a shell that reads a script doesn't wait here, its signals are handled between the commands.
+*/
+int lsh_wait_input(void){
+    struct pollfd fds[3];
+    uint64_t count;
+
+    if(!lsh_job_control || lsh_sigfd < 0){
+        return 1;
+    }
+    fflush(stdout);     //the prompt
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].fd = lsh_sigfd;
+    fds[1].events = POLLIN;
+    fds[2].fd = lsh_prompt_fd;      //poll() skips it while it is -1
+    fds[2].events = POLLIN;
+    for(;;){
+        if(poll(fds, 3, -1) < 0){
+            return 1;
+        }
+        if(fds[1].revents & POLLIN){
+            lsh_handle_signals();
+            if(lsh_interrupted){
+                return 0;
+            }
+        }
+        if(fds[0].revents & (POLLIN | POLLHUP | POLLERR)){
+            return 1;
+        }
+        if((fds[2].revents & POLLIN) && read(lsh_prompt_fd, &count, sizeof(count)) == sizeof(count)){
+            return 2;
+        }
+    }
+}
+
+void lsh_set_trap(int sig, const char *action){
+    free(lsh_traps[sig]);
+    lsh_traps[sig] = NULL;
+    if(action != NULL && (lsh_traps[sig] = strdup(action)) == NULL){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    if(sig == 0 || sig == LSH_TRAP_ERR || sig == SIGINT || sig == SIGQUIT){
+        return;     //these are read from lsh_sigfd whether they are trapped or not
+    }
+    if(action != NULL && action[0] != '\0'){
+        signal(sig, SIG_DFL);       //an ignored signal never becomes pending, signalfd wouldn't see it
+        sigaddset(&lsh_sigmask, sig);
+    }
+    else{
+        sigdelset(&lsh_sigmask, sig);
+        if(action != NULL || (lsh_job_control && (sig == SIGTSTP || sig == SIGTTIN || sig == SIGTTOU))){
+            signal(sig, SIG_IGN);
+        }
+        else{
+            signal(sig, SIG_DFL);
+        }
+    }
+    lsh_update_sigfd();
+}
+
+//EXIT, ERR or a signal, by name or number. -1 if it is none of them.
+int lsh_trap_number(const char *name){
+    if(strcasecmp(name, "EXIT") == 0 || strcmp(name, "0") == 0){
+        return 0;
+    }
+    if(strcasecmp(name, "ERR") == 0){
+        return LSH_TRAP_ERR;
+    }
+    return lsh_signal_number(name);
+}
+
+void lsh_print_trap(int sig){
+    const char *p;
+
+    fprintf(LSH_STDOUT, "trap -- '");
+    for(p = lsh_traps[sig]; *p != '\0'; p++){
+        if(*p == '\''){
+            fprintf(LSH_STDOUT, "'\\''");
+        }
+        else{
+            fputc(*p, LSH_STDOUT);
+        }
+    }
+    if(sig == 0 || sig == LSH_TRAP_ERR){
+        fprintf(LSH_STDOUT, "' %s\n", sig == 0 ? "EXIT" : "ERR");
+    }
+    else if(sig < (int)(sizeof(lsh_signal_names) / sizeof(char*))){
+        fprintf(LSH_STDOUT, "' SIG%s\n", lsh_signal_names[sig]);
+    }
+    else{
+        fprintf(LSH_STDOUT, "' %d\n", sig);
+    }
+}
+
+/*
+"trap" lists the traps, "trap 'commands' SIG ..." sets one, "trap '' SIG" ignores the signal and "trap - SIG" (or
+just "trap SIG") puts the default back.
+*/
+int lsh_trap(char** args){
+    const char *action = args[1];
+    int sig, i = 2;
+
+    if(args[1] == NULL){
+        for(sig = 0; sig <= NSIG; sig++){
+            if(lsh_traps[sig] != NULL){
+                lsh_print_trap(sig);
+            }
+        }
+        return 1;
+    }
+    if(args[2] == NULL){
+        i = 1;      //"trap INT" resets INT
+        action = "-";
+    }
+    for(; args[i] != NULL; i++){
+        sig = lsh_trap_number(args[i]);
+        if(sig < 0 || sig == SIGKILL || sig == SIGSTOP){
+            fprintf(stderr, "lsh: trap: %s: invalid signal specification\n", args[i]);
+            lsh_last_status = 1;
+            continue;
+        }
+        lsh_set_trap(sig, strcmp(action, "-") == 0 ? NULL : action);
+    }
+    return 1;
+}
+
+/*
+history. every command line typed at the prompt is appended to ~/.lsh_history (or $HISTFILE) as one record ending in
+a '\0'. the file is opened with O_APPEND and each record goes out in a single write(), so several shells can add to
+it at the same time without mixing their lines up.
+
+we don't read the file at startup, we mmap() it. the offsets of the records are only found when something asks for
+them, and only for the part of the file we haven't looked at yet, so a big history costs nothing until it is used.
+since the records end in '\0' they can be used as strings right where they are in the mapping.
+*/
+struct lsh_trigram{
+    unsigned int key;       //the three bytes, 0 for a free slot (a record has no '\0' inside)
+    int *ids;       //the records that contain it, oldest first
+    int len, cap;
+};
+
+struct lsh_history{
+    int fd;
+    char *map;
+    size_t maplen;
+    size_t scanned;     //how much of the mapping the index covers
+    size_t *offsets;
+    int len, cap;
+    struct lsh_trigram *grams;      //open addressing, the size is a power of two
+    int ngrams, gramcap;
+    int grammed;        //how many records are in the trigram index
+};
+
+struct lsh_history lsh_hist = {-1, NULL, 0, 0, NULL, 0, 0, NULL, 0, 0, 0};
+
+void lsh_init_history(void){
+    struct lsh_str path = {NULL, 0, 0};
+    const char *file = getenv("HISTFILE"), *home = getenv("HOME");
+
+    if(file == NULL){
+        if(home == NULL){
+            return;
+        }
+        lsh_str_append(&path, home, strlen(home));
+        lsh_str_append(&path, "/" LSH_HISTFILE, strlen("/" LSH_HISTFILE));
+        file = path.data;
+    }
+    lsh_hist.fd = open(file, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if(lsh_hist.fd < 0){
+        perror("lsh: history");
+    }
+    free(path.data);
+}
+
+/*
+function: lsh_history_sync
+map whatever the file has grown to (our own records and the ones of other shells) and index the new records.
+*/
+void lsh_history_sync(void){
+    struct stat st;
+    char *map, *p, *end, *nul;
+
+    if(lsh_hist.fd < 0 || fstat(lsh_hist.fd, &st) < 0 || (size_t)st.st_size <= lsh_hist.maplen){
+        return;
+    }
+    if(lsh_hist.map == NULL){
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, lsh_hist.fd, 0);
+    }
+    else{
+        map = mremap(lsh_hist.map, lsh_hist.maplen, st.st_size, MREMAP_MAYMOVE);
+    }
+    if(map == MAP_FAILED){
+        return;
+    }
+    lsh_hist.map = map;
+    lsh_hist.maplen = st.st_size;
+
+    //a record is only complete once its '\0' is there, another shell may be in the middle of writing one
+    end = lsh_hist.map + lsh_hist.maplen;
+    for(p = lsh_hist.map + lsh_hist.scanned; p < end; p++){
+        nul = memchr(p, '\0', end - p);
+        if(nul == NULL){
+            break;
+        }
+        if(lsh_hist.len == lsh_hist.cap){
+            lsh_hist.cap = lsh_hist.cap ? lsh_hist.cap * 2 : 256;
+            lsh_hist.offsets = realloc(lsh_hist.offsets, lsh_hist.cap * sizeof(size_t));
+            if(!lsh_hist.offsets){
+                fprintf(stderr,"lsh: allocation error\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        lsh_hist.offsets[lsh_hist.len++] = p - lsh_hist.map;
+        p = nul;
+        lsh_hist.scanned = nul + 1 - lsh_hist.map;
+    }
+}
+
+//append a command line to the history, without its trailing newline. blank lines are left out.
+void lsh_history_add(const char *text, size_t len){
+    char *record;
+
+    while(len > 0 && (text[len - 1] == '\n' || text[len - 1] == ' ' || text[len - 1] == '\t')){
+        len--;
+    }
+    if(lsh_hist.fd < 0 || len == 0 || strspn(text, " \t\n") >= len){
+        return;
+    }
+    record = lsh_arena_alloc(len + 1);
+    memcpy(record, text, len);
+    record[len] = '\0';
+    if(write(lsh_hist.fd, record, len + 1) != (ssize_t)(len + 1)){      //one write, so it lands in one piece
+        perror("lsh: history");
+    }
+}
+
+//the i-th record (from 0) of the history, NULL past the end.
+const char *lsh_history_get(int i){
+    lsh_history_sync();
+    return i >= 0 && i < lsh_hist.len ? lsh_hist.map + lsh_hist.offsets[i] : NULL;
+}
+
+/*
+searching the history. a linear strstr() over hundreds of thousands of records is too slow to redo on every key of an
+incremental search, so we keep a trigram index: for every three consecutive bytes, the list of records that contain
+them. a record can only contain the text we look for if it contains all of its trigrams, so we walk the shortest of
+those lists from its newest end, skip the records missing from the other lists, and only run strstr() on what is left.
+the lists grow at their end as records are added, which keeps them sorted without any work.
+*/
+unsigned int lsh_trigram_key(const char *p){
+    return (unsigned char)p[0] << 16 | (unsigned char)p[1] << 8 | (unsigned char)p[2];
+}
+
+struct lsh_trigram *lsh_trigram_slot(struct lsh_trigram *grams, int cap, unsigned int key){
+    unsigned int i = (key * 2654435761u) & (cap - 1);
+
+    while(grams[i].key != 0 && grams[i].key != key){
+        i = (i + 1) & (cap - 1);
+    }
+    return &grams[i];
+}
+
+//the list of a trigram, created if needed.
+struct lsh_trigram *lsh_trigram_get(unsigned int key){
+    struct lsh_trigram *old = lsh_hist.grams, *slot;
+    int oldcap = lsh_hist.gramcap, i;
+
+    if(2 * (lsh_hist.ngrams + 1) > lsh_hist.gramcap){       //keep it at most half full
+        lsh_hist.gramcap = oldcap ? oldcap * 2 : 4096;
+        lsh_hist.grams = calloc(lsh_hist.gramcap, sizeof(struct lsh_trigram));
+        if(!lsh_hist.grams){
+            fprintf(stderr,"lsh: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        for(i = 0; i < oldcap; i++){
+            if(old[i].key != 0){
+                *lsh_trigram_slot(lsh_hist.grams, lsh_hist.gramcap, old[i].key) = old[i];
+            }
+        }
+        free(old);
+    }
+    slot = lsh_trigram_slot(lsh_hist.grams, lsh_hist.gramcap, key);
+    if(slot->key == 0){
+        slot->key = key;
+        lsh_hist.ngrams++;
+    }
+    return slot;
+}
+
+//the list of a trigram if some record has it.
+struct lsh_trigram *lsh_trigram_find(unsigned int key){
+    struct lsh_trigram *slot;
+
+    if(lsh_hist.gramcap == 0){
+        return NULL;
+    }
+    slot = lsh_trigram_slot(lsh_hist.grams, lsh_hist.gramcap, key);
+    return slot->key == key ? slot : NULL;
+}
+
+//add the records that came in since the last time to the trigram index.
+void lsh_history_index(void){
+    struct lsh_trigram *gram;
+    const char *entry;
+    int id;
+    size_t i, n;
+
+    lsh_history_sync();
+    for(id = lsh_hist.grammed; id < lsh_hist.len; id++){
+        entry = lsh_hist.map + lsh_hist.offsets[id];
+        n = strlen(entry);
+        for(i = 0; i + 3 <= n; i++){
+            gram = lsh_trigram_get(lsh_trigram_key(entry + i));
+            if(gram->len > 0 && gram->ids[gram->len - 1] == id){
+                continue;       //the same trigram twice in one record
+            }
+            if(gram->len == gram->cap){
+                gram->cap = gram->cap ? gram->cap * 2 : 4;
+                gram->ids = realloc(gram->ids, gram->cap * sizeof(int));
+                if(!gram->ids){
+                    fprintf(stderr,"lsh: allocation error\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            gram->ids[gram->len++] = id;
+        }
+    }
+    lsh_hist.grammed = lsh_hist.len;
+}
+
+//is id in the sorted list of gram? the lists can be long, so a binary search.
+int lsh_trigram_has(struct lsh_trigram *gram, int id){
+    int lo = 0, hi = gram->len;
+
+    while(lo < hi){
+        int mid = (lo + hi) / 2;
+        if(gram->ids[mid] < id){
+            lo = mid + 1;
+        }
+        else{
+            hi = mid;
+        }
+    }
+    return lo < gram->len && gram->ids[lo] == id;
+}
+
+/*
+function: lsh_history_search
+the newest record before number "before" that contains text, or -1. an incremental search calls it again with the
+record it found as "before" to get the next older one.
+*/
+int lsh_history_search(const char *text, int before){
+    struct lsh_trigram *grams[64], *shortest = NULL;
+    size_t n = strlen(text), i;
+    int ngrams = 0, id, j, k, lo, hi;
+
+    lsh_history_index();
+    if(before > lsh_hist.len){
+        before = lsh_hist.len;
+    }
+    if(n < 3){      //no trigram to go by, but a short text matches something recent soon enough
+        for(id = before - 1; id >= 0; id--){
+            if(strstr(lsh_hist.map + lsh_hist.offsets[id], text) != NULL){
+                return id;
+            }
+        }
+        return -1;
+    }
+    for(i = 0; i + 3 <= n && ngrams < 64; i++){
+        grams[ngrams] = lsh_trigram_find(lsh_trigram_key(text + i));
+        if(grams[ngrams] == NULL){
+            return -1;      //no record has this trigram, so none has the text
+        }
+        if(shortest == NULL || grams[ngrams]->len < shortest->len){
+            shortest = grams[ngrams];
+        }
+        ngrams++;
+    }
+
+    //the last entry of the shortest list that is below "before"
+    lo = 0;
+    hi = shortest->len;
+    while(lo < hi){
+        int mid = (lo + hi) / 2;
+        if(shortest->ids[mid] < before){
+            lo = mid + 1;
+        }
+        else{
+            hi = mid;
+        }
+    }
+    for(k = lo - 1; k >= 0; k--){
+        id = shortest->ids[k];
+        for(j = 0; j < ngrams && (grams[j] == shortest || lsh_trigram_has(grams[j], id)); j++){
+        }
+        if(j == ngrams && strstr(lsh_hist.map + lsh_hist.offsets[id], text) != NULL){
+            return id;
+        }
+    }
+    return -1;
+}
+
+/*
+the line editor. when we read from a terminal, we put it in raw mode and do the editing ourselves instead of letting
+the terminal collect a line: the emacs keys (Ctrl-A, Ctrl-E, Ctrl-K, Alt-F ...), the arrows, going up and down the
+history and Ctrl-R to search it.
+
+after every key the line is redisplayed, but only from the first byte that differs from what is on the screen, and
+everything that goes to the terminal for one key (escape sequences and text) is collected and written at once. on a
+slow terminal one small write() per key is the difference between typing and waiting.
+*/
+#define LSH_CTRL(c) ((c) & 0x1f)
+
+enum{
+    LSH_KEY_ESC = 27,
+    LSH_KEY_BACKSPACE = 127,
+    LSH_KEY_UP = 1000,
+    LSH_KEY_DOWN,
+    LSH_KEY_LEFT,
+    LSH_KEY_RIGHT,
+    LSH_KEY_HOME,
+    LSH_KEY_END,
+    LSH_KEY_DELETE,
+    LSH_KEY_WORD_LEFT,
+    LSH_KEY_WORD_RIGHT,
+    LSH_KEY_ALT = 2000,     //Alt-x is LSH_KEY_ALT + 'x'
+    LSH_KEY_EOF = -1,
+    LSH_KEY_INTERRUPT = -2,
+    LSH_KEY_PROMPT = -3     //not a key, the prompt has changed
+};
+
+struct lsh_editor{
+    const char *prompt;
+    int prompt_width;
+    int cols;
+    struct lsh_str buf;     //the line being edited
+    size_t pos;     //the cursor, as a byte offset into buf
+    struct lsh_str shown;       //what the screen shows after the prompt
+    size_t shown_pos;       //where the terminal's cursor is, as a byte offset into shown
+    struct lsh_str out;     //what goes to the terminal for this key
+    int hist_pos;       //the history record on display, lsh_hist.len for the line being typed
+    struct lsh_str scratch;     //the line being typed while we look at the history
+};
+
+struct lsh_str lsh_kill_buffer = {NULL, 0, 0};      //for Ctrl-Y
+
+int lsh_write_all(int fd, const char *buf, size_t len);
+
+//how many columns a byte takes: control characters show up as ^X, the tail bytes of a UTF-8 character take none.
+int lsh_byte_width(unsigned char c){
+    if(c < 0x20 || c == 0x7f){
+        return 2;
+    }
+    return (c & 0xc0) == 0x80 ? 0 : 1;
+}
+
+int lsh_text_width(const char *s, size_t n){
+    int width = 0;
+    size_t i;
+
+    for(i = 0; i < n; i++){
+        width += lsh_byte_width(s[i]);
+    }
+    return width;
+}
+
+//the width of a prompt, the escape sequences that color it take no room.
+int lsh_prompt_width(const char *prompt){
+    int width = 0;
+
+    while(*prompt != '\0'){
+        if(*prompt == '\033' && prompt[1] == '['){
+            for(prompt += 2; *prompt != '\0' && (*prompt < 0x40 || *prompt > 0x7e); prompt++){
+            }
+            prompt += *prompt != '\0';
+            continue;
+        }
+        width += lsh_byte_width(*prompt++);
+    }
+    return width;
+}
+
+int lsh_is_utf8_tail(const struct lsh_str *s, size_t i){
+    return i < s->len && (s->data[i] & 0xc0) == 0x80;
+}
+
+size_t lsh_edit_prev(struct lsh_editor *ed, size_t i){
+    do{
+        i--;
+    }while(i > 0 && lsh_is_utf8_tail(&ed->buf, i));
+    return i;
+}
+
+size_t lsh_edit_next(struct lsh_editor *ed, size_t i){
+    do{
+        i++;
+    }while(lsh_is_utf8_tail(&ed->buf, i));
+    return i;
+}
+
+void lsh_edit_printf(struct lsh_editor *ed, const char *fmt, int n){
+    char seq[64];
+    int len = snprintf(seq, sizeof(seq), fmt, n);
+
+    lsh_str_append(&ed->out, seq, len < (int)sizeof(seq) ? len : (int)sizeof(seq) - 1);
+}
+
+//move the cursor between two columns counted from the start of the prompt, the line may wrap.
+void lsh_edit_move(struct lsh_editor *ed, int from, int to){
+    int rows = to / ed->cols - from / ed->cols;
+
+    if(from == to){
+        return;     //typing at the end of the line needs no cursor movement at all
+    }
+    if(rows < 0){
+        lsh_edit_printf(ed, "\033[%dA", -rows);
+    }
+    else if(rows > 0){
+        lsh_edit_printf(ed, "\033[%dB", rows);
+    }
+    lsh_str_append(&ed->out, "\r", 1);
+    if(to % ed->cols > 0){
+        lsh_edit_printf(ed, "\033[%dC", to % ed->cols);
+    }
+}
+
+void lsh_edit_flush(struct lsh_editor *ed){
+    lsh_write_all(STDOUT_FILENO, ed->out.data, ed->out.len);
+    ed->out.len = 0;
+}
+
+/*
+function: lsh_edit_refresh
+bring the screen up to date with buf and pos. only the part of the line after the first change is written again.
+*/
+void lsh_edit_refresh(struct lsh_editor *ed){
+    size_t same = 0, i;
+    char ctl[2] = {'^', 0};
+    int at = ed->prompt_width + lsh_text_width(ed->shown.data, ed->shown_pos), end;
+
+    while(same < ed->buf.len && same < ed->shown.len && ed->buf.data[same] == ed->shown.data[same]){
+        same++;
+    }
+    while(same > 0 && lsh_is_utf8_tail(&ed->buf, same)){
+        same--;     //redraw whole characters
+    }
+    if(same < ed->buf.len || same < ed->shown.len){
+        end = ed->prompt_width + lsh_text_width(ed->buf.data, same);
+        lsh_edit_move(ed, at, end);
+        for(i = same; i < ed->buf.len; i++){
+            if(lsh_byte_width(ed->buf.data[i]) == 2){
+                ctl[1] = ed->buf.data[i] ^ 0x40;
+                lsh_str_append(&ed->out, ctl, 2);
+            }
+            else{
+                lsh_str_append(&ed->out, ed->buf.data + i, 1);
+            }
+        }
+        at = end + lsh_text_width(ed->buf.data + same, ed->buf.len - same);
+        if(at % ed->cols == 0 && same < ed->buf.len){
+            lsh_str_append(&ed->out, "\r\n", 2);        //the terminal waits in the last column, go to the next row for real
+        }
+        if(same < ed->shown.len){
+            lsh_str_append(&ed->out, "\033[J", 3);      //what is left of the old line
+        }
+    }
+    lsh_edit_move(ed, at, ed->prompt_width + lsh_text_width(ed->buf.data, ed->pos));
+    lsh_edit_flush(ed);
+
+    ed->shown.len = 0;
+    lsh_str_append(&ed->shown, ed->buf.data ? ed->buf.data : "", ed->buf.len);
+    ed->shown_pos = ed->pos;
+}
+
+//draw another prompt in place of the current one (Ctrl-R does that), the line is drawn again after it.
+void lsh_edit_set_prompt(struct lsh_editor *ed, const char *prompt){
+    lsh_edit_move(ed, ed->prompt_width + lsh_text_width(ed->shown.data, ed->shown_pos), 0);
+    lsh_str_append(&ed->out, prompt, strlen(prompt));
+    lsh_str_append(&ed->out, "\033[J", 3);
+    ed->prompt_width = lsh_prompt_width(prompt);
+    if(ed->prompt_width > 0 && ed->prompt_width % ed->cols == 0){
+        lsh_str_append(&ed->out, "\r\n", 2);
+    }
+    ed->shown.len = 0;
+    ed->shown_pos = 0;
+    lsh_edit_refresh(ed);
+}
+
+//the prompt and the whole line again, on a fresh row.
+void lsh_edit_redraw(struct lsh_editor *ed){
+    lsh_str_append(&ed->out, ed->prompt, strlen(ed->prompt));
+    if(ed->prompt_width > 0 && ed->prompt_width % ed->cols == 0){
+        lsh_str_append(&ed->out, "\r\n", 2);
+    }
+    ed->shown.len = 0;
+    ed->shown_pos = 0;
+}
+
+void lsh_edit_complete(struct lsh_editor *ed, int again);
+
+void lsh_edit_replace(struct lsh_editor *ed, const char *text, size_t len, size_t pos){
+    ed->buf.len = 0;
+    lsh_str_append(&ed->buf, text, len);
+    ed->pos = pos;
+}
+
+void lsh_edit_insert(struct lsh_editor *ed, const char *text, size_t n){
+    size_t tail = ed->buf.len - ed->pos;
+
+    lsh_str_append(&ed->buf, text, n);      //makes the room
+    memmove(ed->buf.data + ed->pos + n, ed->buf.data + ed->pos, tail);
+    memcpy(ed->buf.data + ed->pos, text, n);
+    ed->pos += n;
+}
+
+//delete the bytes between from and to, and put them in the kill buffer if asked to.
+void lsh_edit_delete(struct lsh_editor *ed, size_t from, size_t to, int kill){
+    if(from >= to){
+        return;
+    }
+    if(kill){
+        lsh_kill_buffer.len = 0;
+        lsh_str_append(&lsh_kill_buffer, ed->buf.data + from, to - from);
+    }
+    memmove(ed->buf.data + from, ed->buf.data + to, ed->buf.len - to + 1);
+    ed->buf.len -= to - from;
+    if(ed->pos > to){
+        ed->pos -= to - from;
+    }
+    else if(ed->pos > from){
+        ed->pos = from;
+    }
+}
+
+int lsh_is_word_char(char c){
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || (c & 0x80);
+}
+
+size_t lsh_edit_word_left(struct lsh_editor *ed){
+    size_t i = ed->pos;
+
+    while(i > 0 && !lsh_is_word_char(ed->buf.data[i - 1])){
+        i--;
+    }
+    while(i > 0 && lsh_is_word_char(ed->buf.data[i - 1])){
+        i--;
+    }
+    return i;
+}
+
+size_t lsh_edit_word_right(struct lsh_editor *ed){
+    size_t i = ed->pos;
+
+    while(i < ed->buf.len && !lsh_is_word_char(ed->buf.data[i])){
+        i++;
+    }
+    while(i < ed->buf.len && lsh_is_word_char(ed->buf.data[i])){
+        i++;
+    }
+    return i;
+}
+
+//Up and Down: the line being typed is kept aside while we look at older ones.
+void lsh_edit_history(struct lsh_editor *ed, int pos){
+    const char *entry;
+
+    lsh_history_sync();
+    if(pos < 0 || pos > lsh_hist.len){
+        return;
+    }
+    if(ed->hist_pos >= lsh_hist.len){
+        ed->scratch.len = 0;
+        lsh_str_append(&ed->scratch, ed->buf.data ? ed->buf.data : "", ed->buf.len);
+    }
+    ed->hist_pos = pos;
+    if(pos == lsh_hist.len){
+        lsh_edit_replace(ed, ed->scratch.data ? ed->scratch.data : "", ed->scratch.len, ed->scratch.len);
+    }
+    else{
+        entry = lsh_history_get(pos);
+        lsh_edit_replace(ed, entry, strlen(entry), strlen(entry));
+    }
+}
+
+//one byte from the terminal, LSH_KEY_EOF at the end and LSH_KEY_INTERRUPT if a signal says to give up the line.
+int lsh_edit_byte(int timeout){
+    struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+    unsigned char c;
+    int ready;
+
+    if(timeout >= 0 && poll(&pfd, 1, timeout) <= 0){
+        return LSH_KEY_EOF;
+    }
+    if(timeout < 0 && (ready = lsh_wait_input()) != 1){
+        return ready == 2 ? LSH_KEY_PROMPT : LSH_KEY_INTERRUPT;
+    }
+    return read(STDIN_FILENO, &c, 1) == 1 ? c : LSH_KEY_EOF;
+}
+
+//a key, with the escape sequences of the arrows and the others turned into one LSH_KEY_ code.
+int lsh_edit_key(void){
+    int c = lsh_edit_byte(-1), param = 0, mod = 0;
+
+    if(c != LSH_KEY_ESC){
+        return c;
+    }
+    c = lsh_edit_byte(50);      //a lone Esc has nothing after it
+    if(c == LSH_KEY_EOF){
+        return LSH_KEY_ESC;
+    }
+    if(c != '[' && c != 'O'){
+        return LSH_KEY_ALT + c;
+    }
+    while((c = lsh_edit_byte(50)) >= '0' && c <= ';'){     //"\033[1;5C" is Ctrl-Right
+        if(c == ';'){
+            mod = param;
+            param = 0;
+        }
+        else{
+            param = param * 10 + c - '0';
+        }
+    }
+    if(mod != 0){
+        mod = param;
+    }
+    switch(c){
+    case 'A': return LSH_KEY_UP;
+    case 'B': return LSH_KEY_DOWN;
+    case 'C': return mod >= 3 ? LSH_KEY_WORD_RIGHT : LSH_KEY_RIGHT;
+    case 'D': return mod >= 3 ? LSH_KEY_WORD_LEFT : LSH_KEY_LEFT;
+    case 'H': return LSH_KEY_HOME;
+    case 'F': return LSH_KEY_END;
+    case '~':
+        if(param == 1 || param == 7){
+            return LSH_KEY_HOME;
+        }
+        if(param == 4 || param == 8){
+            return LSH_KEY_END;
+        }
+        if(param == 3){
+            return LSH_KEY_DELETE;
+        }
+    }
+    return 0;       //something we don't know, ignore it
+}
+
+/*
+function: lsh_edit_search
+Ctrl-R. every key typed narrows the search, the newest record that has the text is shown, Ctrl-R again goes to an
+older one. Enter runs what is shown, Ctrl-G or Esc give back the line as it was, any other key takes the record
+into the line and is handled as usual. it returns that key, 0 if there is none.
+*/
+int lsh_edit_search(struct lsh_editor *ed){
+    struct lsh_str query = {NULL, 0, 0}, prompt = {NULL, 0, 0}, saved = {NULL, 0, 0};
+    size_t saved_pos = ed->pos;
+    int found = -1, failed = 0, c, id;
+    const char *entry, *match;
+    char ch;
+
+    lsh_str_append(&saved, ed->buf.data ? ed->buf.data : "", ed->buf.len);
+    lsh_str_append(&query, "", 0);
+    lsh_history_sync();
+    for(;;){
+        prompt.len = 0;
+        lsh_str_append(&prompt, failed ? "(failed reverse-i-search)`" : "(reverse-i-search)`",
+                       strlen(failed ? "(failed reverse-i-search)`" : "(reverse-i-search)`"));
+        lsh_str_append(&prompt, query.data, query.len);
+        lsh_str_append(&prompt, "': ", 3);
+        if(found >= 0){
+            entry = lsh_history_get(found);
+            match = strstr(entry, query.data);
+            lsh_edit_replace(ed, entry, strlen(entry), match ? (size_t)(match - entry) : 0);
+        }
+        lsh_edit_set_prompt(ed, prompt.data);
+
+        c = lsh_edit_key();
+        if(c == LSH_KEY_PROMPT){
+            continue;       //it can wait until the search is over
+        }
+        if(c == LSH_CTRL('R')){
+            id = query.len > 0 ? lsh_history_search(query.data, found >= 0 ? found : lsh_hist.len) : -1;
+        }
+        else if((c == LSH_KEY_BACKSPACE || c == LSH_CTRL('H')) && query.len > 0){
+            query.data[--query.len] = '\0';
+            id = query.len > 0 ? lsh_history_search(query.data, lsh_hist.len) : -1;
+            found = -1;
+        }
+        else if(c >= ' ' && c < LSH_KEY_BACKSPACE){
+            ch = c;
+            lsh_str_append(&query, &ch, 1);
+            id = lsh_history_search(query.data, found >= 0 ? found + 1 : lsh_hist.len);
+        }
+        else{
+            break;
+        }
+        failed = id < 0 && query.len > 0;
+        if(id >= 0){
+            found = id;
+        }
+    }
+    if(c == LSH_CTRL('G') || c == LSH_KEY_ESC){
+        lsh_edit_replace(ed, saved.data, saved.len, saved_pos);
+        c = 0;
+    }
+    else if(found >= 0){
+        ed->hist_pos = found;
+    }
+    lsh_edit_set_prompt(ed, ed->prompt);
+    free(query.data);
+    free(prompt.data);
+    free(saved.data);
+    return c;
+}
+
+char *lsh_render_prompt(void);
+
+/*
+function: lsh_edit_line
+read a line from the terminal with editing. it returns the line with a '\n' at the end like getline() does, NULL
+after a Ctrl-C, and sets *eof for a Ctrl-D on an empty line. a NULL prompt means $PS1, which is drawn again
+whenever one of its slow parts comes in.
+*/
+char *lsh_edit_line(const char *prompt, int *eof){
+    struct lsh_editor ed;
+    struct termios raw, orig;
+    struct winsize ws;
+    char *line = NULL, utf8[4], *ps1 = NULL, *fresh;
+    size_t a, b, m;
+    int c, n, i, last, prev_key = 0;
+
+    memset(&ed, 0, sizeof(ed));
+    *eof = 0;
+    if(prompt == NULL){
+        prompt = ps1 = lsh_render_prompt();
+    }
+    ed.prompt = prompt;
+    ed.prompt_width = lsh_prompt_width(prompt);
+    ed.cols = ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 ? ws.ws_col : 80;
+    lsh_history_sync();
+    ed.hist_pos = lsh_hist.len;
+    lsh_str_append(&ed.buf, "", 0);
+    lsh_str_append(&ed.shown, "", 0);
+
+    tcgetattr(STDIN_FILENO, &orig);
+    raw = orig;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);        //Ctrl-C and Ctrl-Z come to us as bytes
+    raw.c_cflag |= CS8;
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+
+    fputs(prompt, stdout);
+    fflush(stdout);
+    if(ed.prompt_width > 0 && ed.prompt_width % ed.cols == 0){
+        lsh_str_append(&ed.out, "\r\n", 2);
+        lsh_edit_flush(&ed);
+    }
+
+    for(;;){
+        c = lsh_edit_key();
+        if(c == LSH_CTRL('R')){
+            c = lsh_edit_search(&ed);
+        }
+        last = prev_key;
+        prev_key = c;
+        switch(c){
+        case 0:
+            break;
+        case LSH_KEY_PROMPT:
+            if(ps1 != NULL && strcmp(fresh = lsh_render_prompt(), ps1) != 0){
+                lsh_edit_set_prompt(&ed, fresh);
+                free(ps1);
+                ed.prompt = ps1 = fresh;
+            }
+            else if(ps1 != NULL){
+                free(fresh);
+            }
+            break;
+        case '\r':
+        case '\n':
+            ed.pos = ed.buf.len;
+            lsh_edit_refresh(&ed);
+            lsh_write_all(STDOUT_FILENO, "\r\n", 2);
+            lsh_str_append(&ed.buf, "\n", 1);
+            line = strdup(ed.buf.data);
+            goto done;
+        case LSH_CTRL('C'):
+            ed.pos = ed.buf.len;
+            lsh_edit_refresh(&ed);
+            lsh_write_all(STDOUT_FILENO, "^C", 2);
+            raise(SIGINT);      //blocked, so it shows up on lsh_sigfd and runs its trap like any other Ctrl-C
+            /* fall through */
+        case LSH_KEY_INTERRUPT:
+            lsh_handle_signals();
+            lsh_interrupted = 1;
+            goto done;
+        case LSH_KEY_EOF:
+            *eof = 1;
+            goto done;
+        case LSH_CTRL('D'):
+            if(ed.buf.len == 0){
+                lsh_write_all(STDOUT_FILENO, "\r\n", 2);
+                *eof = 1;
+                goto done;
+            }
+            /* fall through */
+        case LSH_KEY_DELETE:
+            if(ed.pos < ed.buf.len){
+                lsh_edit_delete(&ed, ed.pos, lsh_edit_next(&ed, ed.pos), 0);
+            }
+            break;
+        case LSH_KEY_BACKSPACE:
+        case LSH_CTRL('H'):
+            if(ed.pos > 0){
+                lsh_edit_delete(&ed, lsh_edit_prev(&ed, ed.pos), ed.pos, 0);
+            }
+            break;
+        case LSH_CTRL('A'):
+        case LSH_KEY_HOME:
+            ed.pos = 0;
+            break;
+        case LSH_CTRL('E'):
+        case LSH_KEY_END:
+            ed.pos = ed.buf.len;
+            break;
+        case LSH_CTRL('B'):
+        case LSH_KEY_LEFT:
+            if(ed.pos > 0){
+                ed.pos = lsh_edit_prev(&ed, ed.pos);
+            }
+            break;
+        case LSH_CTRL('F'):
+        case LSH_KEY_RIGHT:
+            if(ed.pos < ed.buf.len){
+                ed.pos = lsh_edit_next(&ed, ed.pos);
+            }
+            break;
+        case LSH_KEY_ALT + 'b':
+        case LSH_KEY_WORD_LEFT:
+            ed.pos = lsh_edit_word_left(&ed);
+            break;
+        case LSH_KEY_ALT + 'f':
+        case LSH_KEY_WORD_RIGHT:
+            ed.pos = lsh_edit_word_right(&ed);
+            break;
+        case LSH_CTRL('K'):
+            lsh_edit_delete(&ed, ed.pos, ed.buf.len, 1);
+            break;
+        case LSH_CTRL('U'):
+            lsh_edit_delete(&ed, 0, ed.pos, 1);
+            break;
+        case LSH_CTRL('W'):     //back to the previous blank, not just to the previous word
+            for(i = ed.pos; i > 0 && ed.buf.data[i - 1] == ' '; i--){
+            }
+            for(; i > 0 && ed.buf.data[i - 1] != ' '; i--){
+            }
+            lsh_edit_delete(&ed, i, ed.pos, 1);
+            break;
+        case LSH_KEY_ALT + LSH_KEY_BACKSPACE:
+            lsh_edit_delete(&ed, lsh_edit_word_left(&ed), ed.pos, 1);
+            break;
+        case LSH_KEY_ALT + 'd':
+            lsh_edit_delete(&ed, ed.pos, lsh_edit_word_right(&ed), 1);
+            break;
+        case LSH_CTRL('Y'):
+            if(lsh_kill_buffer.len > 0){
+                lsh_edit_insert(&ed, lsh_kill_buffer.data, lsh_kill_buffer.len);
+            }
+            break;
+        case LSH_CTRL('T'):     //swap the two characters before the cursor (at the end) or around it
+            if(ed.pos > 0 && ed.buf.len > 1){
+                b = ed.pos < ed.buf.len ? lsh_edit_next(&ed, ed.pos) : ed.pos;
+                m = lsh_edit_prev(&ed, b);
+                if(m > 0){
+                    a = lsh_edit_prev(&ed, m);
+                    memcpy(utf8, ed.buf.data + a, m - a);
+                    n = m - a;
+                    memmove(ed.buf.data + a, ed.buf.data + m, b - m);
+                    memcpy(ed.buf.data + a + (b - m), utf8, n);
+                    ed.pos = b;
+                }
+            }
+            break;
+        case LSH_CTRL('P'):
+        case LSH_KEY_UP:
+            lsh_edit_history(&ed, ed.hist_pos - 1);
+            break;
+        case LSH_CTRL('N'):
+        case LSH_KEY_DOWN:
+            lsh_edit_history(&ed, ed.hist_pos + 1);
+            break;
+        case LSH_CTRL('L'):
+            lsh_str_append(&ed.out, "\033[H\033[2J", 7);
+            lsh_edit_redraw(&ed);
+            break;
+        case '\t':
+            lsh_edit_complete(&ed, last == '\t');
+            break;
+        default:
+            if(c < ' ' || (c > LSH_KEY_BACKSPACE && c < 256 && (c & 0xc0) == 0x80) || c >= 256){
+                break;      //a key that does nothing here, or a stray UTF-8 tail byte
+            }
+            utf8[0] = c;
+            n = c < 0x80 ? 1 : c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : 2;      //a whole UTF-8 character goes in at once
+            for(i = 1; i < n; i++){
+                c = lsh_edit_byte(50);
+                if(c < 0){
+                    break;
+                }
+                utf8[i] = c;
+            }
+            lsh_edit_insert(&ed, utf8, i);
+        }
+        lsh_edit_refresh(&ed);
+    }
+
+done:
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &orig);
+    free(ed.buf.data);
+    free(ed.shown.data);
+    free(ed.out.data);
+    free(ed.scratch.data);
+    free(ps1);
+    return line;
+}
+
+/*
+"history" lists the whole history, "history n" the last n records and "history -s text" the ones that contain text,
+newest first.
+*/
+int lsh_history(char** args){
+    const char *search, *entry;
+    int i, first = 0;
+
+    lsh_history_sync();
+    if(args[1] != NULL && strcmp(args[1], "-s") == 0){
+        if((search = args[2]) == NULL){
+            fprintf(stderr, "lsh: history: -s: expected a search text\n");
+            lsh_last_status = 2;
+            return 1;
+        }
+        for(i = lsh_history_search(search, INT_MAX); i >= 0; i = lsh_history_search(search, i)){
+            fprintf(LSH_STDOUT, "%5d  %s\n", i + 1, lsh_history_get(i));
+        }
+        return 1;
+    }
+    else if(args[1] != NULL){
+        first = lsh_hist.len - atoi(args[1]);
+        if(first < 0){
+            first = 0;
+        }
+    }
+    for(i = first; (entry = lsh_history_get(i)) != NULL; i++){
+        fprintf(LSH_STDOUT, "%5d  %s\n", i + 1, entry);
+    }
+    return 1;
+}
+
+/*
+most commands execute by a shell are programs, but not all of them, some of them are built right into the shell.
+
+these commands could only cange the shell's operation if they were implemented within the shell proces itself.\
+
+the shell process itself needs to execute chdir(), so that its own current directory is updated, then, when it launches child processes, 
+they will inherit that directory too.
+
+Now, we are going to add some commands to the shell itself, like cd, exit and help.
+*/
+int lsh_cd(char** args);
+int lsh_help(char**args);
+int lsh_exit(char** args);
+int lsh_set(char** args);
+int lsh_let(char** args);
+int lsh_local(char** args);
+int lsh_return(char** args);
+int lsh_jobs_builtin(char** args);
+int lsh_fg(char** args);
+int lsh_bg(char** args);
+int lsh_kill(char** args);
+int lsh_trap(char** args);
+int lsh_history(char** args);
+int lsh_alias(char** args);
+int lsh_unalias(char** args);
+int lsh_cat(char** args);
+int lsh_tee(char** args);
+int lsh_cgroup(char** args);
+int lsh_ulimit(char** args);
+int lsh_pin(char** args);
+int lsh_memo(char** args);      //forward declarations
+
+//an array of builtin command names
+char * builtin_str[] = {
+    "cd",
+    "help",
+    "exit",
+    "set",
+    "let",
+    "local",
+    "return",
+    "jobs",
+    "fg",
+    "bg",
+    "kill",
+    "trap",
+    "history",
+    "alias",
+    "unalias",
+    "cat",
+    "tee",
+    "cgroup",
+    "ulimit",
+    "pin",
+    "memo"
+};
+
+//an array of their corresponding functions
+int (*builtin_func[]) (char**) = {      //it is an array of function pointers (that take array of strings and return an int)
+    &lsh_cd,
+    &lsh_help,
+    &lsh_exit,
+    &lsh_set,
+    &lsh_let,
+    &lsh_local,
+    &lsh_return,
+    &lsh_jobs_builtin,
+    &lsh_fg,
+    &lsh_bg,
+    &lsh_kill,
+    &lsh_trap,
+    &lsh_history,
+    &lsh_alias,
+    &lsh_unalias,
+    &lsh_cat,
+    &lsh_tee,
+    &lsh_cgroup,
+    &lsh_ulimit,
+    &lsh_pin,
+    &lsh_memo
+};
+
+int lsh_num_builtis(){
+    return sizeof(builtin_str) / sizeof(char*);
+}
+
+int lsh_cd(char** args){        //implement cd
+    if(args[1] == NULL){        //if its second argument does not exist, then print an error message.
+        fprintf(stderr, "lsh: expected argument to \"cd\"\n");
+        lsh_last_status = 1;
+    }
+    else{
+        if(chdir(args[1]) != 0){     //call chdir(), check for errors, and returns
+            perror("lsh");
+            lsh_last_status = 1;
+        }
+    }
+    return 1;
+}
+
+
+//the help function prints a nice message and the names of all the buitins.
+int lsh_help(char** args){
+    int i;
+    fprintf(LSH_STDOUT, "LSH\n");
+    fprintf(LSH_STDOUT, "Type program names and arguments, and hit enter.\n");
+    fprintf(LSH_STDOUT, "The following are built in:\n");
+
+    for(i = 0; i < lsh_num_builtis(); i++){
+        fprintf(LSH_STDOUT, " %s\n", builtin_str[i]);
+    }
+
+    fprintf(LSH_STDOUT, "Use the man command for information on other programs.\n");
+    return 1;
+
+}
+
+//the exit function returns 0, as a signal for the command loop to terminate.
+int lsh_exit(char** args){
+    return 0;
+}
+
+/*
+shell options are integers that change how the shell behaves, "set -o name=value" changes one and "set" lists them all.
+*/
+int lsh_glob_threads = 0;       //how many threads walk the directory tree for "**", 0 means one per CPU
+int lsh_max_jobs = 0;       //how many background jobs may run at once, 0 means no limit, see lsh_throttle_jobs()
+int lsh_memo_size = 256;        //megabytes for "memo" to keep outputs in, see lsh_memo()
+
+char * option_str[] = {
+    "globthreads",
+    "zygote",
+    "maxjobs",
+    "cgroups",
+    "spread",
+    "memosize"
+};
+
+int * option_val[] = {
+    &lsh_glob_threads,
+    &lsh_use_zygote,
+    &lsh_max_jobs,
+    &lsh_use_cgroups,
+    &lsh_spread,
+    &lsh_memo_size
+};
+
+int lsh_num_options(){
+    return sizeof(option_str) / sizeof(char*);
+}
+
+int lsh_set(char** args){
+    char *value, *end;
+    long n;
+    int i, j;
+
+    if(args[1] == NULL){
+        for(i = 0; i < lsh_num_options(); i++){
+            fprintf(LSH_STDOUT, "%s=%d\n", option_str[i], *option_val[i]);
+        }
+        return 1;
+    }
+
+    for(i = 1; args[i] != NULL; i++){
+        if(strcmp(args[i], "-o") != 0 || args[i + 1] == NULL || (value = strchr(args[i + 1], '=')) == NULL){
+            fprintf(stderr, "lsh: usage: set [-o name=value]...\n");
+            lsh_last_status = 2;
+            return 1;
+        }
+        i++;
+        for(j = 0; j < lsh_num_options(); j++){
+            if(strncmp(args[i], option_str[j], value - args[i]) == 0 && option_str[j][value - args[i]] == '\0'){
+                errno = 0;
+                n = strtol(value + 1, &end, 10);
+                if(value[1] < '0' || value[1] > '9' || *end != '\0' || errno != 0 || n > INT_MAX){
+                    fprintf(stderr, "lsh: set: %s: %s: invalid value\n", option_str[j], value + 1);
+                    lsh_last_status = 2;
+                    return 1;
+                }
+                *option_val[j] = n;
+                break;
+            }
+        }
+        if(j == lsh_num_options()){
+            fprintf(stderr, "lsh: set: %.*s: no such option\n", (int)(value - args[i]), args[i]);
+            lsh_last_status = 1;
+        }
+    }
+    return 1;
+}
+
+
+/*
+shell variables live in a hash table. the ones that came with the environment are exported, and an exported variable
+is mirrored into the environment with setenv(), so every child we exec sees it without us building an envp.
+"$?" (the last exit status) and "$$" (the shell's pid) are computed when they are read.
+*/
+struct lsh_var{
+    struct lsh_var *next;
+    char *name;
+    char *value;
+    int exported;
+};
+
+struct lsh_var *lsh_vars[LSH_VAR_BUCKETS];
+
+/*
+each running function has a frame with its positional parameters ($1, $2, ..., $#, $@) and the values its local
+variables hid, which are put back when it returns.
+*/
+struct lsh_local{
+    struct lsh_local *next;
+    char *name;
+    char *value;        //NULL if the variable was not set
+    int exported;
+};
+
+struct lsh_frame{
+    struct lsh_frame *prev;
+    char **argv;        //argv[0] is the function's name
+    int argc;
+    struct lsh_local *locals;
+};
+
+struct lsh_frame *lsh_frame = NULL;
+
+/*
+a subshell that runs inside the shell keeps a layer: the first time a variable is changed in it, its old value is
+saved there (the same way "local" saves one), and when the subshell is over they are all put back.
+*/
+struct lsh_layer{
+    struct lsh_layer *prev;
+    struct lsh_local *saved;
+};
+
+struct lsh_layer *lsh_layer = NULL;
+
+unsigned int lsh_hash(const char *s, size_t n){
+    unsigned int h = 2166136261u;       //FNV-1a
+    size_t i;
+
+    for(i = 0; i < n; i++){
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+struct lsh_var *lsh_findvar(const char *name, size_t n){
+    struct lsh_var *var;
+
+    for(var = lsh_vars[lsh_hash(name, n) % LSH_VAR_BUCKETS]; var != NULL; var = var->next){
+        if(strncmp(var->name, name, n) == 0 && var->name[n] == '\0'){
+            return var;
+        }
+    }
+    return NULL;
+}
+
+//the value of a variable, or NULL if it is not set.
+char *lsh_getvar(const char *name, size_t n){
+    static char number[32];
+    struct lsh_var *var;
+    struct lsh_str all = {NULL, 0, 0};
+    char *value;
+    int argc = lsh_frame ? lsh_frame->argc : 0, i;
+
+    if(n == 1 && (name[0] == '$' || name[0] == '!')){
+        lsh_rc_impure();        //different in every shell
+    }
+    if(n == 1 && (name[0] == '?' || name[0] == '$' || name[0] == '#')){
+        snprintf(number, sizeof(number), "%d", name[0] == '?' ? lsh_last_status : name[0] == '#' ? argc : (int)getpid());
+        return number;
+    }
+    if(n == 1 && name[0] == '!'){
+        if(lsh_last_bg_pid == 0){
+            return NULL;
+        }
+        snprintf(number, sizeof(number), "%d", (int)lsh_last_bg_pid);
+        return number;
+    }
+    if(n == 1 && (name[0] == '@' || name[0] == '*')){
+        for(i = 1; i <= argc; i++){
+            lsh_str_append(&all, " ", i > 1);
+            lsh_str_append(&all, lsh_frame->argv[i], strlen(lsh_frame->argv[i]));
+        }
+        value = lsh_arena_strndup(all.data ? all.data : "", all.len);
+        free(all.data);
+        return value;
+    }
+    if(name[0] >= '0' && name[0] <= '9'){
+        i = atoi(name);
+        if(i == 0){
+            return "lsh";
+        }
+        return i <= argc ? lsh_frame->argv[i] : NULL;
+    }
+    var = lsh_findvar(name, n);
+    lsh_rc_read(name, n, var ? var->value : NULL);
+    return var ? var->value : NULL;
+}
+
+void lsh_layer_save(const char *name){
+    struct lsh_local *saved;
+    struct lsh_var *var;
+
+    if(lsh_layer == NULL){
+        return;
+    }
+    for(saved = lsh_layer->saved; saved != NULL; saved = saved->next){
+        if(strcmp(saved->name, name) == 0){
+            return;     //only the value from before the subshell counts
+        }
+    }
+    saved = malloc(sizeof(*saved));
+    if(!saved || !(saved->name = strdup(name))){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    var = lsh_findvar(name, strlen(name));
+    saved->value = NULL;
+    if(var != NULL && !(saved->value = strdup(var->value))){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    saved->exported = var ? var->exported : 0;
+    saved->next = lsh_layer->saved;
+    lsh_layer->saved = saved;
+}
+
+void lsh_setvar(const char *name, const char *value, int export){
+    struct lsh_var *var = lsh_findvar(name, strlen(name));
+    unsigned int bucket;
+
+    lsh_rc_wrote(name);
+    lsh_layer_save(name);
+    if(var == NULL){
+        var = calloc(1, sizeof(*var));
+        if(!var || !(var->name = strdup(name))){
+            fprintf(stderr,"lsh: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        bucket = lsh_hash(name, strlen(name)) % LSH_VAR_BUCKETS;
+        var->next = lsh_vars[bucket];
+        lsh_vars[bucket] = var;
+    }
+    free(var->value);
+    var->value = strdup(value);
+    if(!var->value){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    var->exported |= export;
+    if(var->exported){
+        setenv(name, value, 1);
+    }
+}
+
+void lsh_unsetvar(const char *name){
+    struct lsh_var **link = &lsh_vars[lsh_hash(name, strlen(name)) % LSH_VAR_BUCKETS], *var;
+
+    lsh_rc_wrote(name);
+    lsh_layer_save(name);
+    for(; (var = *link) != NULL; link = &var->next){
+        if(strcmp(var->name, name) == 0){
+            if(var->exported){
+                unsetenv(name);
+            }
+            *link = var->next;
+            free(var->name);
+            free(var->value);
+            free(var);
+            return;
+        }
+    }
+}
+
+void lsh_init_vars(void){
+    extern char **environ;
+    char **env, *eq, *name;
+
+    for(env = environ; *env != NULL; env++){
+        if((eq = strchr(*env, '=')) != NULL && lsh_is_name(*env, eq - *env)){
+            name = strndup(*env, eq - *env);
+            if(!name){
+                fprintf(stderr,"lsh: allocation error\n");
+                exit(EXIT_FAILURE);
+            }
+            lsh_setvar(name, eq + 1, 0);
+            lsh_findvar(name, strlen(name))->exported = 1;      //it already is in the environment, don't setenv() while we walk it
+            free(name);
+        }
+    }
+}
+
+//put back the saved values of a function's local variables or a subshell's layer, and free the list.
+void lsh_restore_locals(struct lsh_local *local){
+    struct lsh_local *next;
+    struct lsh_var *var;
+
+    for(; local != NULL; local = next){
+        next = local->next;
+        if(local->value == NULL){
+            lsh_unsetvar(local->name);
+        }
+        else{
+            var = lsh_findvar(local->name, strlen(local->name));
+            if(var != NULL && var->exported && !local->exported){
+                lsh_unsetvar(local->name);
+            }
+            lsh_setvar(local->name, local->value, local->exported);
+        }
+        free(local->name);
+        free(local->value);
+        free(local);
+    }
+}
+
+//a word like NAME=value in front of a command is an assignment.
+int lsh_is_assignment(const char *word){
+    const char *eq = strchr(word, '=');
+
+    return eq != NULL && lsh_is_name(word, eq - word);
+}
+
+/*
+the prompt. it is $PS1 (just "> " if that is not set), with these backslash sequences replaced:
+
+    \u user         \h host         \w working directory (~ for $HOME)      \W its last component
+    \$ '#' for root, '$' for the others     \? exit status of the last command
+    \D how long the last command took       \t the time     \e escape, for colors
+    \g git branch   \l load average         \[ \] are left out, \\ is a backslash
+
+most of them cost nothing, but finding the git branch means going up the directory tree and reading files that may
+be on a slow disk or a network mount. \g and \l are computed by a thread instead: the prompt shows right away with
+what we had the last time (or nothing) and the thread tells the line editor through an eventfd when it has the new
+value, then the prompt is drawn again. the values are cached: the branch for a directory until the next command runs
+(the command may have been a "git checkout"), the load average for a few seconds.
+*/
+
+struct lsh_prompt_cache{
+    pthread_mutex_t lock;
+    char *git_cwd;      //the directory the branch is for
+    char branch[256];
+    unsigned long git_gen;      //lsh_cmd_gen when it was computed
+    char load[32];
+    time_t load_time;
+    int busy;       //a thread is at work
+};
+
+struct lsh_prompt_cache lsh_prompt_cache = {PTHREAD_MUTEX_INITIALIZER, NULL, "", 0, "", 0, 0};
+unsigned long lsh_cmd_gen = 0;      //counts the commands run, so that the cached branch can tell it is old
+long long lsh_last_duration = 0;        //in nanoseconds
+
+struct lsh_prompt_job{
+    char *cwd;
+    unsigned long gen;
+    int git, load;
+};
+
+//the branch checked out in the repository that dir is in, "" if it is in none.
+void lsh_git_branch(const char *dir, char *branch, size_t size){
+    struct lsh_str path = {NULL, 0, 0};
+    char head[256], *end;
+    ssize_t n;
+    size_t len = strlen(dir);
+    int fd;
+
+    branch[0] = '\0';
+    for(;;){
+        path.len = 0;
+        lsh_str_append(&path, dir, len);
+        lsh_str_append(&path, "/.git/HEAD", 10);
+        fd = open(path.data, O_RDONLY | O_CLOEXEC);
+        if(fd >= 0){
+            n = read(fd, head, sizeof(head) - 1);
+            close(fd);
+            head[n > 0 ? n : 0] = '\0';
+            if((end = strchr(head, '\n')) != NULL){
+                *end = '\0';
+            }
+            if(strncmp(head, "ref: refs/heads/", 16) == 0){
+                snprintf(branch, size, "%s", head + 16);
+            }
+            else if(n >= 7){
+                snprintf(branch, size, "%.7s", head);       //a detached HEAD, show the commit
+            }
+            break;
+        }
+        while(len > 0 && dir[len - 1] != '/'){      //one directory up
+            len--;
+        }
+        if(len <= 1){
+            break;
+        }
+        len--;
+    }
+    free(path.data);
+}
+
+void *lsh_prompt_worker(void *arg){
+    struct lsh_prompt_job *job = arg;
+    char branch[256] = "", load[32] = "";
+    double avg[1];
+    uint64_t one = 1;
+
+    if(job->git){
+        lsh_git_branch(job->cwd, branch, sizeof(branch));
+    }
+    if(job->load && getloadavg(avg, 1) == 1){
+        snprintf(load, sizeof(load), "%.2f", avg[0]);
+    }
+
+    pthread_mutex_lock(&lsh_prompt_cache.lock);
+    if(job->git){
+        free(lsh_prompt_cache.git_cwd);
+        lsh_prompt_cache.git_cwd = job->cwd;
+        job->cwd = NULL;
+        memcpy(lsh_prompt_cache.branch, branch, sizeof(branch));
+        lsh_prompt_cache.git_gen = job->gen;
+    }
+    if(job->load){
+        memcpy(lsh_prompt_cache.load, load, sizeof(load));
+        lsh_prompt_cache.load_time = time(NULL);
+    }
+    lsh_prompt_cache.busy = 0;
+    pthread_mutex_unlock(&lsh_prompt_cache.lock);
+
+    if(write(lsh_prompt_fd, &one, sizeof(one)) < 0){        //wake up the line editor
+        perror("lsh: prompt");
+    }
+    free(job->cwd);
+    free(job);
+    return NULL;
+}
+
+//hand the segments that are out of date to a thread. called with the cache locked.
+void lsh_prompt_refresh(const char *cwd, int git, int load){
+    struct lsh_prompt_job *job;
+    pthread_t thread;
+
+    if(lsh_prompt_cache.busy || (!git && !load) || lsh_prompt_fd < 0){
+        return;
+    }
+    job = calloc(1, sizeof(*job));
+    if(!job || !(job->cwd = strdup(cwd))){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    job->gen = lsh_cmd_gen;
+    job->git = git;
+    job->load = load;
+    if(pthread_create(&thread, NULL, lsh_prompt_worker, job) != 0){
+        free(job->cwd);
+        free(job);
+        return;
+    }
+    pthread_detach(thread);
+    lsh_prompt_cache.busy = 1;
+}
+
+void lsh_prompt_duration(struct lsh_str *out, long long ns){
+    char buf[32];
+    long long ms = ns / 1000000;
+
+    if(ms < 1000){
+        snprintf(buf, sizeof(buf), "%lldms", ms);
+    }
+    else if(ms < 60000){
+        snprintf(buf, sizeof(buf), "%lld.%llds", ms / 1000, ms % 1000 / 100);
+    }
+    else{
+        snprintf(buf, sizeof(buf), "%lldm%02llds", ms / 60000, ms % 60000 / 1000);
+    }
+    lsh_str_append(out, buf, strlen(buf));
+}
+
+/*
+function: lsh_render_prompt
+the prompt as it should look right now, in a malloc()ed string. it never waits for \g or \l.
+*/
+char *lsh_render_prompt(void){
+    const char *ps1 = lsh_getvar("PS1", 3), *p, *home = getenv("HOME"), *s;
+    struct lsh_str out = {NULL, 0, 0};
+    char cwd[4096] = "", buf[256];
+    int need_git = 0, need_load = 0;
+    time_t now = time(NULL);
+
+    if(ps1 == NULL){
+        ps1 = "> ";
+    }
+    if(getcwd(cwd, sizeof(cwd)) == NULL){
+        cwd[0] = '\0';
+    }
+    lsh_str_append(&out, "", 0);
+    for(p = ps1; *p != '\0'; p++){
+        if(*p != '\\' || p[1] == '\0'){
+            lsh_str_append(&out, p, 1);
+            continue;
+        }
+        buf[0] = '\0';
+        switch(*++p){
+        case 'u':
+            s = getenv("USER");
+            snprintf(buf, sizeof(buf), "%s", s ? s : "");
+            break;
+        case 'h':
+            if(gethostname(buf, sizeof(buf)) == 0){
+                buf[sizeof(buf) - 1] = '\0';
+                buf[strcspn(buf, ".")] = '\0';
+            }
+            break;
+        case 'w':
+            if(home != NULL && home[0] != '\0' && strncmp(cwd, home, strlen(home)) == 0
+               && (cwd[strlen(home)] == '/' || cwd[strlen(home)] == '\0')){
+                lsh_str_append(&out, "~", 1);
+                lsh_str_append(&out, cwd + strlen(home), strlen(cwd + strlen(home)));
+            }
+            else{
+                lsh_str_append(&out, cwd, strlen(cwd));
+            }
+            break;
+        case 'W':
+            s = strrchr(cwd, '/');
+            s = s && s[1] != '\0' ? s + 1 : cwd;
+            lsh_str_append(&out, s, strlen(s));
+            break;
+        case '$':
+            snprintf(buf, sizeof(buf), "%c", geteuid() == 0 ? '#' : '$');
+            break;
+        case '?':
+            snprintf(buf, sizeof(buf), "%d", lsh_last_status);
+            break;
+        case 'D':
+            lsh_prompt_duration(&out, lsh_last_duration);
+            break;
+        case 't':
+            strftime(buf, sizeof(buf), "%H:%M:%S", localtime(&now));
+            break;
+        case 'g':
+            pthread_mutex_lock(&lsh_prompt_cache.lock);
+            if(lsh_prompt_cache.git_cwd != NULL && strcmp(lsh_prompt_cache.git_cwd, cwd) == 0){
+                snprintf(buf, sizeof(buf), "%s", lsh_prompt_cache.branch);      //maybe old, the thread will tell
+                need_git = lsh_prompt_cache.git_gen != lsh_cmd_gen;
+            }
+            else{
+                need_git = 1;
+            }
+            pthread_mutex_unlock(&lsh_prompt_cache.lock);
+            break;
+        case 'l':
+            pthread_mutex_lock(&lsh_prompt_cache.lock);
+            snprintf(buf, sizeof(buf), "%s", lsh_prompt_cache.load);
+            need_load = now - lsh_prompt_cache.load_time >= LSH_LOAD_TTL;
+            pthread_mutex_unlock(&lsh_prompt_cache.lock);
+            break;
+        case 'e':
+            buf[0] = '\033';
+            buf[1] = '\0';
+            break;
+        case '[':
+        case ']':
+            break;
+        case '\\':
+            lsh_str_append(&out, "\\", 1);
+            break;
+        default:
+            lsh_str_append(&out, p - 1, 2);
+        }
+        lsh_str_append(&out, buf, strlen(buf));
+    }
+
+    pthread_mutex_lock(&lsh_prompt_cache.lock);
+    lsh_prompt_refresh(cwd, need_git, need_load);
+    pthread_mutex_unlock(&lsh_prompt_cache.lock);
+    return out.data;
+}
+
+void lsh_init_prompt(void){
+    lsh_prompt_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+/*
+functions: "name() { list; }" keeps a copy of the parsed body in a table, and lsh_execute() looks a command up there
+before it tries the builtins and PATH, so calling a function runs its body right in the shell, with no fork and no
+parsing. the body is copied out of the arena onto the heap because it has to outlive the line that defined it.
+*/
+struct lsh_func{
+    struct lsh_func *next;
+    char *name;
+    struct lsh_node *body;
+    int running;        //how many calls of it are active right now
+};
+
+struct lsh_func *lsh_funcs[LSH_FUNC_BUCKETS];
+int lsh_func_depth = 0;
+int lsh_returning = 0;      //set by "return", the commands of the function body stop running until the call is over
+
+char *lsh_strdup(const char *s){
+    char *copy = strdup(s);
+
+    if(!copy){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    return copy;
+}
+
+struct lsh_node *lsh_node_dup(struct lsh_node *node){
+    struct lsh_node *copy;
+    int n;
+
+    if(node == NULL){
+        return NULL;
+    }
+    copy = malloc(sizeof(*copy));
+    if(!copy){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    *copy = *node;
+    if(node->words != NULL){
+        for(n = 0; node->words[n] != NULL; n++){
+        }
+        copy->words = malloc((n + 1) * sizeof(char*));
+        if(!copy->words){
+            fprintf(stderr,"lsh: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        for(n = 0; node->words[n] != NULL; n++){
+            copy->words[n] = lsh_strdup(node->words[n]);
+        }
+        copy->words[n] = NULL;
+    }
+    copy->name = node->name ? lsh_strdup(node->name) : NULL;
+    copy->left = lsh_node_dup(node->left);
+    copy->right = lsh_node_dup(node->right);
+    return copy;
+}
+
+void lsh_node_free(struct lsh_node *node){
+    int n;
+
+    if(node == NULL){
+        return;
+    }
+    for(n = 0; node->words != NULL && node->words[n] != NULL; n++){
+        free(node->words[n]);
+    }
+    free(node->words);
+    free(node->name);
+    lsh_node_free(node->left);
+    lsh_node_free(node->right);
+    free(node);
+}
+
+struct lsh_func *lsh_findfunc(const char *name){
+    struct lsh_func *func;
+
+    for(func = lsh_funcs[lsh_hash(name, strlen(name)) % LSH_FUNC_BUCKETS]; func != NULL; func = func->next){
+        if(strcmp(func->name, name) == 0){
+            return func;
+        }
+    }
+    return NULL;
+}
+
+void lsh_define_function(const char *name, struct lsh_node *body){
+    struct lsh_func *func = lsh_findfunc(name);
+    unsigned int bucket;
+
+    if(func == NULL){
+        func = calloc(1, sizeof(*func));
+        if(!func){
+            fprintf(stderr,"lsh: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        func->name = lsh_strdup(name);
+        bucket = lsh_hash(name, strlen(name)) % LSH_FUNC_BUCKETS;
+        func->next = lsh_funcs[bucket];
+        lsh_funcs[bucket] = func;
+    }
+    else if(func->running == 0){
+        lsh_node_free(func->body);      //a function that redefines itself keeps running its old body, that one is never freed
+    }
+    func->body = lsh_node_dup(body);
+}
+
+int lsh_exec_node(struct lsh_node *node);
+
+//run a function with argv as its positional parameters, like lsh_execute() it returns 0 when the shell should exit.
+int lsh_call_function(struct lsh_func *func, char **argv){
+    struct lsh_frame frame;
+    int status;
+
+    if(lsh_func_depth >= LSH_FUNC_MAX_DEPTH){
+        fprintf(stderr, "lsh: %s: maximum function nesting level exceeded (%d)\n", func->name, LSH_FUNC_MAX_DEPTH);
+        lsh_last_status = 1;
+        return 1;
+    }
+    frame.prev = lsh_frame;
+    frame.argv = argv;
+    for(frame.argc = 0; argv[frame.argc + 1] != NULL; frame.argc++){
+    }
+    frame.locals = NULL;
+    lsh_frame = &frame;
+    lsh_func_depth++;
+    func->running++;
+
+    lsh_last_status = 0;
+    status = lsh_exec_node(func->body);
+    lsh_returning = 0;
+
+    func->running--;
+    lsh_func_depth--;
+    lsh_frame = frame.prev;
+    lsh_restore_locals(frame.locals);       //put back what the local variables hid
+    return status;
+}
+
+//local name[=value]...: the variables keep their new values only until the function returns.
+int lsh_local(char** args){
+    struct lsh_local *local;
+    struct lsh_var *var;
+    char *eq, *name;
+    int i;
+
+    if(lsh_frame == NULL){
+        fprintf(stderr, "lsh: local: can only be used in a function\n");
+        lsh_last_status = 1;
+        return 1;
+    }
+    for(i = 1; args[i] != NULL; i++){
+        eq = strchr(args[i], '=');
+        name = eq ? lsh_arena_strndup(args[i], eq - args[i]) : args[i];
+        if(!lsh_is_name(name, strlen(name))){
+            fprintf(stderr, "lsh: local: `%s': not a valid identifier\n", args[i]);
+            lsh_last_status = 1;
+            continue;
+        }
+        for(local = lsh_frame->locals; local != NULL && strcmp(local->name, name) != 0; local = local->next){
+        }
+        if(local == NULL){      //only the value from before the first "local" is saved
+            local = malloc(sizeof(*local));
+            if(!local){
+                fprintf(stderr,"lsh: allocation error\n");
+                exit(EXIT_FAILURE);
+            }
+            var = lsh_findvar(name, strlen(name));
+            local->name = lsh_strdup(name);
+            local->value = var ? lsh_strdup(var->value) : NULL;
+            local->exported = var ? var->exported : 0;
+            local->next = lsh_frame->locals;
+            lsh_frame->locals = local;
+        }
+        lsh_setvar(name, eq ? eq + 1 : "", 0);
+    }
+    return 1;
+}
+
+int lsh_return(char** args){
+    if(lsh_frame == NULL){
+        fprintf(stderr, "lsh: return: can only `return' from a function\n");
+        lsh_last_status = 1;
+        return 1;
+    }
+    lsh_last_status = args[1] ? atoi(args[1]) & 255 : lsh_prev_status;
+    lsh_returning = 1;
+    return 1;
+}
+
+/*
+aliases. "alias ll='ls -l'" makes the command ll run "ls -l". other shells put the text of an alias back into the
+lexer every time it is used, we split it into words once, when it is defined: lsh_execute() finds the alias for the
+first word of a command and puts its words in front of the other arguments, which are then expanded as usual.
+since an alias is spliced into a single command it can't hold operators like ";" or "|", use a function for those.
+a word that is quoted ('ll' or \ll) is not an alias, and an alias whose first word is an alias (even itself) is
+expanded again, but each alias only once for a command.
+*/
+struct lsh_alias{
+    struct lsh_alias *next;
+    char *name;
+    char *value;        //as it was given, for "alias" to print
+    char **words;
+};
+
+struct lsh_alias *lsh_aliases[LSH_ALIAS_BUCKETS];
+
+struct lsh_alias *lsh_findalias(const char *name){
+    struct lsh_alias *alias;
+
+    for(alias = lsh_aliases[lsh_hash(name, strlen(name)) % LSH_ALIAS_BUCKETS]; alias != NULL; alias = alias->next){
+        if(strcmp(alias->name, name) == 0){
+            return alias;
+        }
+    }
+    return NULL;
+}
+
+void lsh_free_alias(struct lsh_alias *alias){
+    int i;
+
+    for(i = 0; alias->words[i] != NULL; i++){
+        free(alias->words[i]);
+    }
+    free(alias->words);
+    free(alias->name);
+    free(alias->value);
+    free(alias);
+}
+
+void lsh_unset_alias(const char *name){
+    struct lsh_alias **link = &lsh_aliases[lsh_hash(name, strlen(name)) % LSH_ALIAS_BUCKETS], *alias;
+
+    for(; (alias = *link) != NULL; link = &alias->next){
+        if(strcmp(alias->name, name) == 0){
+            *link = alias->next;
+            lsh_free_alias(alias);
+            return;
+        }
+    }
+}
+
+//returns 0 if value is no simple command (or has an unterminated quote).
+int lsh_set_alias(const char *name, const char *value){
+    struct lsh_arena_pos pos = lsh_arena_mark();
+    struct lsh_alias *alias;
+    const char *p;
+    char **tokens;
+    unsigned int bucket;
+    int n;
+
+    for(p = value + strspn(value, LSH_TOK_DELIM); *p != '\0' && *p != '#'; p += strspn(p, LSH_TOK_DELIM)){
+        if((n = lsh_token_length(p)) < 0){
+            return 0;
+        }
+        p += n;
+    }
+    tokens = lsh_split_line(lsh_arena_strndup(value, strlen(value)));
+    for(n = 0; tokens[n] != NULL; n++){
+        if(lsh_is_operator(tokens[n])){
+            free(tokens);
+            lsh_arena_release(pos);
+            return 0;
+        }
+    }
+    lsh_unset_alias(name);
+    alias = calloc(1, sizeof(*alias));
+    if(!alias || !(alias->words = malloc((n + 1) * sizeof(char*)))){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    alias->name = lsh_strdup(name);
+    alias->value = lsh_strdup(value);
+    for(n = 0; tokens[n] != NULL; n++){
+        alias->words[n] = lsh_strdup(tokens[n]);
+    }
+    alias->words[n] = NULL;
+    free(tokens);
+    lsh_arena_release(pos);
+    bucket = lsh_hash(name, strlen(name)) % LSH_ALIAS_BUCKETS;
+    alias->next = lsh_aliases[bucket];
+    lsh_aliases[bucket] = alias;
+    return 1;
+}
+
+/*
+function: lsh_expand_alias
+words->v[n] is the command's first word (the ones before it are assignments). while it is an alias, it is replaced
+by the alias's words.
+*/
+void lsh_expand_alias(struct lsh_argv *words, int n){
+    struct lsh_alias *alias, *used[LSH_ALIAS_DEPTH];
+    struct lsh_argv out;
+    int depth = 0, i;
+
+    while(words->v[n] != NULL && depth < LSH_ALIAS_DEPTH && (alias = lsh_findalias(words->v[n])) != NULL){
+        for(i = 0; i < depth && used[i] != alias; i++){
+        }
+        if(i < depth){
+            break;
+        }
+        used[depth++] = alias;
+        out.v = NULL;
+        out.len = out.cap = 0;
+        for(i = 0; i < n; i++){
+            lsh_argv_push(&out, words->v[i]);
+        }
+        for(i = 0; alias->words[i] != NULL; i++){
+            lsh_argv_push(&out, alias->words[i]);
+        }
+        for(i = n + 1; i < words->len; i++){
+            lsh_argv_push(&out, words->v[i]);
+        }
+        lsh_argv_push(&out, NULL);      //the array exists even if the alias was empty
+        out.len--;
+        free(words->v);
+        *words = out;
+    }
+}
+
+void lsh_print_alias(struct lsh_alias *alias){
+    const char *p;
+
+    fprintf(LSH_STDOUT, "alias %s='", alias->name);
+    for(p = alias->value; *p != '\0'; p++){
+        if(*p == '\''){
+            fprintf(LSH_STDOUT, "'\\''");
+        }
+        else{
+            fputc(*p, LSH_STDOUT);
+        }
+    }
+    fprintf(LSH_STDOUT, "'\n");
+}
+
+//alias [name[=value]...]: define aliases, or print them (all of them without arguments).
+int lsh_alias(char** args){
+    struct lsh_alias *alias;
+    char *eq, *name;
+    int i;
+
+    if(args[1] == NULL){
+        for(i = 0; i < LSH_ALIAS_BUCKETS; i++){
+            for(alias = lsh_aliases[i]; alias != NULL; alias = alias->next){
+                lsh_print_alias(alias);
+            }
+        }
+        return 1;
+    }
+    for(i = 1; args[i] != NULL; i++){
+        if((eq = strchr(args[i], '=')) == NULL){
+            if((alias = lsh_findalias(args[i])) != NULL){
+                lsh_print_alias(alias);
+            }
+            else{
+                fprintf(stderr, "lsh: alias: %s: not found\n", args[i]);
+                lsh_last_status = 1;
+            }
+            continue;
+        }
+        name = lsh_arena_strndup(args[i], eq - args[i]);
+        if(name[0] == '\0' || strpbrk(name, "/$`'\\" "\"") != NULL){
+            fprintf(stderr, "lsh: alias: `%s': invalid alias name\n", name);
+            lsh_last_status = 1;
+        }
+        else if(!lsh_set_alias(name, eq + 1)){
+            fprintf(stderr, "lsh: alias: %s: an alias must be a single simple command, use a function\n", name);
+            lsh_last_status = 1;
+        }
+    }
+    return 1;
+}
+
+//unalias name... or unalias -a for all of them.
+int lsh_unalias(char** args){
+    struct lsh_alias *alias;
+    int i;
+
+    if(args[1] == NULL){
+        fprintf(stderr, "lsh: usage: unalias [-a] name...\n");
+        lsh_last_status = 2;
+        return 1;
+    }
+    if(strcmp(args[1], "-a") == 0){
+        for(i = 0; i < LSH_ALIAS_BUCKETS; i++){
+            while((alias = lsh_aliases[i]) != NULL){
+                lsh_aliases[i] = alias->next;
+                lsh_free_alias(alias);
+            }
+        }
+        return 1;
+    }
+    for(i = 1; args[i] != NULL; i++){
+        if(lsh_findalias(args[i]) == NULL){
+            fprintf(stderr, "lsh: unalias: %s: not found\n", args[i]);
+            lsh_last_status = 1;
+            continue;
+        }
+        lsh_unset_alias(args[i]);
+    }
+    return 1;
+}
+
+/*
+cat and tee. "cat big.log | grep x" forks for cat, and cat copies every byte twice: from the file into its buffer and
+from the buffer into the pipe. as builtins they run on a thread of the pipeline (see lsh_stage_builtin()) and the bytes
+don't come up to user space at all: copy_file_range() copies from a file to a file, splice() moves them when one end
+is a pipe and sendfile() from a file to anything else, a socket for example. tee(2) duplicates what is in a pipe without
+taking it out, which is all "tee" needs. read() and write() are left for what the kernel can't do, like a terminal.
+the options we don't know (cat -n, tee -i) go to the programs, and so does typing into cat at the terminal.
+*/
+#define LSH_COPY_CHUNK (1 << 20)        //what one call moves at most, between two looks at Ctrl-C
+#define LSH_COPY_BUF 65536      //a pipe's worth
+
+atomic_int lsh_stage_cancel = 0;        //set by the shell on Ctrl-C while it waits for a pipeline of builtins only
+
+//a long copy stops for a signal. the main thread looks at the signalfd, a thread at what the main thread saw there.
+int lsh_copy_stop(void){
+    struct pollfd pfd = {-1, POLLIN, 0};
+
+    if(lsh_out != NULL){
+        return atomic_load(&lsh_stage_cancel);
+    }
+    pfd.fd = lsh_sigfd;
+    return pfd.fd >= 0 && poll(&pfd, 1, 0) > 0;     //handled after the command, like for any other
+}
+
+//move everything from in to out, the fastest way the two kinds of fd allow. -1 with errno on error.
+int lsh_copy_fd(int in, int out){
+    struct stat ist, ost;
+    char buf[LSH_COPY_BUF];
+    enum {LSH_COPY_RANGE, LSH_COPY_SPLICE, LSH_COPY_SENDFILE, LSH_COPY_RW} how = LSH_COPY_RW;
+    ssize_t n;
+    int in_file;
+
+    if(fstat(in, &ist) == 0 && fstat(out, &ost) == 0){
+        in_file = S_ISREG(ist.st_mode) && ist.st_size > 0;      //files in /proc say they are empty, they have to be read
+        if(in_file && S_ISREG(ost.st_mode)){
+            how = LSH_COPY_RANGE;
+        }
+        else if(S_ISFIFO(ist.st_mode) || S_ISFIFO(ost.st_mode)){
+            how = LSH_COPY_SPLICE;
+        }
+        else if(in_file){
+            how = LSH_COPY_SENDFILE;
+        }
+    }
+    for(;;){
+        if(how == LSH_COPY_RANGE){
+            n = copy_file_range(in, NULL, out, NULL, LSH_COPY_CHUNK, 0);
+        }
+        else if(how == LSH_COPY_SPLICE){
+            n = splice(in, NULL, out, NULL, LSH_COPY_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+        }
+        else if(how == LSH_COPY_SENDFILE){
+            n = sendfile(out, in, NULL, LSH_COPY_CHUNK);
+        }
+        else if((n = read(in, buf, sizeof(buf))) > 0 && lsh_write_all(out, buf, n) < 0){
+            return -1;
+        }
+        if(n == 0){
+            return 0;
+        }
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n < 0 && how != LSH_COPY_RW && (errno == EINVAL || errno == EXDEV || errno == EBADF || errno == ENOSYS
+                                           || errno == EOPNOTSUPP)){
+            how = how == LSH_COPY_RANGE ? LSH_COPY_SENDFILE : LSH_COPY_RW;      //all of them go on at the file offsets
+            continue;
+        }
+        if(n < 0){
+            return -1;
+        }
+        if(lsh_copy_stop()){
+            return 0;
+        }
+    }
+}
+
+//move len bytes that are in the pipe rd to out.
+int lsh_drain_pipe(int rd, int out, size_t len){
+    char buf[LSH_COPY_BUF];
+    ssize_t n;
+    int spliced = 1;
+
+    while(len > 0){
+        n = -1;
+        if(spliced && (n = splice(rd, NULL, out, NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE)) < 0 && errno == EINVAL){
+            spliced = 0;        //out is something splice() can't write to
+            continue;
+        }
+        if(!spliced && (n = read(rd, buf, len < sizeof(buf) ? len : sizeof(buf))) > 0 && lsh_write_all(out, buf, n) < 0){
+            return -1;
+        }
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n <= 0){
+            return -1;
+        }
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+every chunk of in is spliced into a pipe of ours. each output but the last gets a tee(2) of it, through a second pipe
+because only the pipe end of a splice() can be anything, and the last output gets the chunk itself.
+it returns -1 when all went through, or the index of the output that failed (nouts for the input), errno tells why.
+*/
+int lsh_tee_fds(int in, int *outs, int nouts){
+    char data[LSH_COPY_BUF];
+    int chunk[2] = {-1, -1}, copy[2] = {-1, -1}, kernel = 1, bad = -1, err = 0, j;
+    ssize_t len = 0, got, off = 0, n;
+
+    if(pipe2(chunk, O_CLOEXEC) < 0 || pipe2(copy, O_CLOEXEC) < 0){
+        kernel = 0;
+    }
+    while(bad < 0 && !lsh_copy_stop()){
+        if(kernel && (len = splice(in, NULL, chunk[1], NULL, LSH_COPY_BUF, SPLICE_F_MOVE)) < 0 && errno == EINVAL){
+            kernel = 0;     //in is a terminal or the like
+            continue;
+        }
+        if(!kernel){
+            len = read(in, data, sizeof(data));
+        }
+        if(len < 0 && errno == EINTR){
+            continue;
+        }
+        if(len <= 0){
+            bad = len < 0 ? nouts : -1;
+            break;
+        }
+        for(j = 0; kernel && bad < 0 && j + 1 < nouts; j++){
+            //our second pipe is empty and as big as the first, so a tee() takes all of the chunk or something is odd
+            if((got = tee(chunk[0], copy[1], len, 0)) != len){
+                if(got > 0 && lsh_drain_pipe(copy[0], outs[j], got) < 0){
+                    bad = j;
+                }
+                got = got > 0 ? got : 0;
+                for(off = 0; bad < 0 && off < len && (n = read(chunk[0], data + off, len - off)) > 0; off += n){
+                }
+                if(bad < 0 && off < len){
+                    bad = nouts;
+                }
+                else if(bad < 0 && lsh_write_all(outs[j], data + got, len - got) < 0){
+                    bad = j;
+                }
+                break;      //the chunk is in data now, the rest is written from there
+            }
+            if(lsh_drain_pipe(copy[0], outs[j], len) < 0){
+                bad = j;
+            }
+        }
+        if(kernel && j + 1 == nouts && bad < 0 && lsh_drain_pipe(chunk[0], outs[j], len) < 0){
+            bad = j;
+        }
+        for(j = kernel ? j + 1 : 0; j < nouts && bad < 0; j++){
+            if(lsh_write_all(outs[j], data, len) < 0){
+                bad = j;
+            }
+        }
+    }
+    err = errno;
+    for(j = 0; j < 2; j++){
+        if(chunk[j] >= 0){
+            close(chunk[j]);
+        }
+        if(copy[j] >= 0){
+            close(copy[j]);
+        }
+    }
+    errno = err;
+    return bad;
+}
+
+//an option we leave to the program.
+int lsh_copy_options(char** args){
+    int i;
+
+    for(i = 1; args[i] != NULL; i++){
+        if(args[i][0] == '-' && args[i][1] != '\0' && !(strcmp(args[0], "tee") == 0 && strcmp(args[i], "-a") == 0)){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int lsh_copy_stdin(char** args){
+    int i;
+
+    for(i = 1; strcmp(args[0], "cat") == 0 && args[i] != NULL; i++){
+        if(strcmp(args[i], "-") == 0){
+            return 1;
+        }
+    }
+    return strcmp(args[0], "tee") == 0 || args[1] == NULL;
+}
+
+//the program, not the builtin, when it has to talk to the user at the terminal.
+int lsh_copy_external(char** args){
+    return lsh_copy_options(args) || (lsh_out == NULL && lsh_copy_stdin(args) && isatty(STDIN_FILENO));
+}
+
+//a failed copy: a reader that went away is what kills the programs with SIGPIPE, they say nothing about it.
+void lsh_copy_error(const char *cmd, const char *name){
+    if(errno == EPIPE){
+        lsh_last_status = 128 + SIGPIPE;
+        return;
+    }
+    fprintf(stderr, "lsh: %s: %s: %s\n", cmd, name, strerror(errno));
+    lsh_last_status = 1;
+}
+
+//cat [file...]: the files one after the other on stdout, "-" or no file at all is stdin.
+int lsh_cat(char** args){
+    int i, fd, out;
+    char *name;
+
+    if(lsh_copy_external(args)){
+        return lsh_launch(args, NULL);
+    }
+    fflush(LSH_STDOUT);
+    out = fileno(LSH_STDOUT);
+    for(i = 1; i == 1 || args[i] != NULL; i++){
+        name = args[i] != NULL ? args[i] : "-";
+        if(strcmp(name, "-") == 0){
+            fd = lsh_in;
+        }
+        else if((fd = open(name, O_RDONLY | O_CLOEXEC)) < 0){
+            lsh_copy_error("cat", name);
+            continue;
+        }
+        if(lsh_copy_fd(fd, out) < 0){
+            lsh_copy_error("cat", name);
+        }
+        if(fd != lsh_in){
+            close(fd);
+        }
+        if(lsh_copy_stop()){
+            lsh_last_status = 128 + SIGINT;
+            break;
+        }
+        if(lsh_last_status == 128 + SIGPIPE || args[i] == NULL){
+            break;
+        }
+    }
+    return 1;
+}
+
+//tee [-a] [file...]: stdin to stdout and to every file, -a appends to them.
+int lsh_tee(char** args){
+    int i, n = 1, bad, flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, *outs;
+    char **names;
+
+    if(lsh_copy_external(args)){
+        return lsh_launch(args, NULL);
+    }
+    for(i = 1; args[i] != NULL; i++){
+    }
+    outs = malloc(i * sizeof(int));
+    names = malloc(i * sizeof(char*));
+    if(!outs || !names){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    fflush(LSH_STDOUT);
+    outs[0] = fileno(LSH_STDOUT);
+    names[0] = "standard output";
+    for(i = 1; args[i] != NULL; i++){
+        if(strcmp(args[i], "-a") == 0){
+            flags = (flags & ~O_TRUNC) | O_APPEND;
+        }
+    }
+    for(i = 1; args[i] != NULL; i++){
+        if(strcmp(args[i], "-a") == 0){
+            continue;
+        }
+        if((outs[n] = open(args[i], flags, 0666)) < 0){
+            lsh_copy_error("tee", args[i]);     //the others still get it
+            continue;
+        }
+        names[n++] = args[i];
+    }
+    bad = n == 1 ? (lsh_copy_fd(lsh_in, outs[0]) < 0 ? 0 : -1) : lsh_tee_fds(lsh_in, outs, n);
+    if(bad >= 0){
+        lsh_copy_error("tee", bad < n ? names[bad] : "standard input");
+    }
+    else if(lsh_copy_stop()){
+        lsh_last_status = 128 + SIGINT;
+    }
+    for(i = 1; i < n; i++){
+        close(outs[i]);
+    }
+    free(outs);
+    free(names);
+    return 1;
+}
+
+/*
+integer arithmetic for $((expr)) and the let builtin. it works on long long like C does and knows C's operators:
++ - * / % ** << >> < <= > >= == != & ^ | && || ?: , unary + - ! ~, ++ and -- before or after a variable, and
+= += -= *= /= %= <<= >>= &= ^= |=. a variable is used by its bare name and an unset or empty one counts as 0.
+
+an expression is compiled once by a Pratt parser into a small postfix program for a stack machine, and the program is
+kept in a cache keyed by the text of the expression. a loop counter like $((i + 1)) is parsed the first time the loop
+body runs, after that each round is a hash lookup and a few instructions. an expression that has a $ in it is only
+known after expansion, it is compiled each time and not cached: that is decided on the text before it is expanded,
+$(($i * 2)) would be a new text every round. the cache keeps a few programs per bucket, so texts that are all different
+(the words of "let" are expanded before we see them) can't make it grow or slow down.
+*/
+enum{
+    LSH_AOP_NUM,        //push value
+    LSH_AOP_LOAD,       //push the variable
+    LSH_AOP_STORE,      //set the variable to the top of the stack, it stays on the stack
+    LSH_AOP_PREINC,     //add value to the variable and push the new value
+    LSH_AOP_POSTINC,    //add value to the variable and push the old value
+    LSH_AOP_NEG, LSH_AOP_NOT, LSH_AOP_BITNOT, LSH_AOP_BOOL,
+    LSH_AOP_ADD, LSH_AOP_SUB, LSH_AOP_MUL, LSH_AOP_DIV, LSH_AOP_MOD, LSH_AOP_POW,
+    LSH_AOP_SHL, LSH_AOP_SHR, LSH_AOP_LT, LSH_AOP_LE, LSH_AOP_GT, LSH_AOP_GE, LSH_AOP_EQ, LSH_AOP_NE,
+    LSH_AOP_AND, LSH_AOP_XOR, LSH_AOP_OR,
+    LSH_AOP_POP,
+    LSH_AOP_JMP,        //jump to target
+    LSH_AOP_JZ,         //pop, jump if it was 0
+    LSH_AOP_ANDJ,       //&&: if the top is 0 keep it and jump, else pop it
+    LSH_AOP_ORJ         //||: if the top is not 0 make it 1 and jump, else pop it
+};
+
+struct lsh_arith_insn{
+    int op;
+    long long value;
+    char *name;
+    int target;
+};
+
+struct lsh_arith_prog{
+    struct lsh_arith_prog *next;        //the next program in the same cache bucket
+    char *text;
+    struct lsh_arith_insn *code;
+    int len, cap, depth, maxdepth;
+};
+
+struct lsh_arith_prog *lsh_arith_cache[LSH_ARITH_BUCKETS];
+
+struct lsh_arith_parser{
+    const char *p;
+    struct lsh_arith_prog *prog;
+    int error;
+};
+
+//the binary operators, their binding power (higher binds tighter) and instruction.
+struct lsh_arith_binop{
+    char *str;
+    int power;
+    int op;
+};
+
+struct lsh_arith_binop lsh_arith_binops[] = {       //longest first, so "**" is not taken for "*"
+    {"**", 14, LSH_AOP_POW}, {"<<", 11, LSH_AOP_SHL}, {">>", 11, LSH_AOP_SHR},
+    {"<=", 10, LSH_AOP_LE}, {">=", 10, LSH_AOP_GE}, {"==", 9, LSH_AOP_EQ}, {"!=", 9, LSH_AOP_NE},
+    {"&&", 5, LSH_AOP_ANDJ}, {"||", 4, LSH_AOP_ORJ},
+    {"*", 13, LSH_AOP_MUL}, {"/", 13, LSH_AOP_DIV}, {"%", 13, LSH_AOP_MOD}, {"+", 12, LSH_AOP_ADD}, {"-", 12, LSH_AOP_SUB},
+    {"<", 10, LSH_AOP_LT}, {">", 10, LSH_AOP_GT}, {"&", 8, LSH_AOP_AND}, {"^", 7, LSH_AOP_XOR}, {"|", 6, LSH_AOP_OR},
+    {"?", 3, LSH_AOP_JZ}, {",", 1, LSH_AOP_POP}
+};
+
+int lsh_arith_emit(struct lsh_arith_prog *prog, int op, long long value, char *name){
+    static const int effect[] = {1, 1, 0, 1, 1, 0, 0, 0, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, -1, -1, -1};
+
+    if(prog->len == prog->cap){
+        prog->cap = prog->cap ? prog->cap * 2 : 16;
+        prog->code = realloc(prog->code, prog->cap * sizeof(struct lsh_arith_insn));
+        if(!prog->code){
+            fprintf(stderr,"lsh: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    prog->code[prog->len].op = op;
+    prog->code[prog->len].value = value;
+    prog->code[prog->len].name = name;
+    prog->code[prog->len].target = 0;
+    prog->depth += effect[op];
+    if(prog->depth > prog->maxdepth){
+        prog->maxdepth = prog->depth;
+    }
+    return prog->len++;
+}
+
+void lsh_arith_space(struct lsh_arith_parser *ps){
+    while(*ps->p == ' ' || *ps->p == '\t' || *ps->p == '\n'){
+        ps->p++;
+    }
+}
+
+//if the input continues with str, skip it (and the spaces after it).
+int lsh_arith_accept(struct lsh_arith_parser *ps, const char *str){
+    lsh_arith_space(ps);
+    if(strncmp(ps->p, str, strlen(str)) != 0){
+        return 0;
+    }
+    ps->p += strlen(str);
+    lsh_arith_space(ps);
+    return 1;
+}
+
+char *lsh_arith_name(struct lsh_arith_parser *ps){
+    const char *start = ps->p;
+
+    while(lsh_is_name(start, ps->p - start + 1)){
+        ps->p++;
+    }
+    if(ps->p == start){
+        return NULL;
+    }
+    return strndup(start, ps->p - start);
+}
+
+void lsh_arith_expr(struct lsh_arith_parser *ps, int minpower);
+
+//the start of an operand: a number, a variable (maybe assigned to or incremented), a unary operator or a parenthesis.
+void lsh_arith_operand(struct lsh_arith_parser *ps){
+    static char *assign_str[] = {"<<=", ">>=", "+=", "-=", "*=", "/=", "%=", "&=", "^=", "|=", "="};
+    static int assign_op[] = {LSH_AOP_SHL, LSH_AOP_SHR, LSH_AOP_ADD, LSH_AOP_SUB, LSH_AOP_MUL, LSH_AOP_DIV, LSH_AOP_MOD,
+        LSH_AOP_AND, LSH_AOP_XOR, LSH_AOP_OR, -1};
+    static char *unary_str[] = {"-", "+", "!", "~"};
+    static int unary_op[] = {LSH_AOP_NEG, -1, LSH_AOP_NOT, LSH_AOP_BITNOT};
+    struct lsh_arith_prog *prog = ps->prog;
+    char *name, *end;
+    long long value;
+    int i;
+
+    lsh_arith_space(ps);
+    if(*ps->p >= '0' && *ps->p <= '9'){
+        value = strtoll(ps->p, &end, 0);
+        ps->p = end;
+        lsh_arith_emit(prog, LSH_AOP_NUM, value, NULL);
+        return;
+    }
+    if(lsh_arith_accept(ps, "(")){
+        lsh_arith_expr(ps, 0);
+        if(!lsh_arith_accept(ps, ")")){
+            ps->error = 1;
+        }
+        return;
+    }
+    if(strncmp(ps->p, "++", 2) == 0 || strncmp(ps->p, "--", 2) == 0){
+        value = *ps->p == '+' ? 1 : -1;
+        lsh_arith_accept(ps, *ps->p == '+' ? "++" : "--");
+        if((name = lsh_arith_name(ps)) == NULL){
+            ps->error = 1;
+            return;
+        }
+        lsh_arith_emit(prog, LSH_AOP_PREINC, value, name);
+        return;
+    }
+    for(i = 0; i < 4; i++){
+        if(lsh_arith_accept(ps, unary_str[i])){
+            lsh_arith_expr(ps, 15);     //unary operators bind tighter than any binary one
+            if(unary_op[i] >= 0){
+                lsh_arith_emit(prog, unary_op[i], 0, NULL);
+            }
+            return;
+        }
+    }
+
+    if((name = lsh_arith_name(ps)) == NULL){
+        ps->error = 1;
+        return;
+    }
+    lsh_arith_space(ps);
+    if(strncmp(ps->p, "++", 2) == 0 || strncmp(ps->p, "--", 2) == 0){
+        lsh_arith_emit(prog, LSH_AOP_POSTINC, *ps->p == '+' ? 1 : -1, name);
+        lsh_arith_accept(ps, *ps->p == '+' ? "++" : "--");
+        return;
+    }
+    for(i = 0; i < (int)(sizeof(assign_str) / sizeof(char*)); i++){
+        if(strncmp(ps->p, assign_str[i], strlen(assign_str[i])) == 0 && ps->p[strlen(assign_str[i])] != '='){
+            ps->p += strlen(assign_str[i]);
+            if(assign_op[i] >= 0){
+                lsh_arith_emit(prog, LSH_AOP_LOAD, 0, strdup(name));
+            }
+            lsh_arith_expr(ps, 1);      //assignments are right associative and take everything but a ","
+            if(assign_op[i] >= 0){
+                lsh_arith_emit(prog, assign_op[i], 0, NULL);
+            }
+            lsh_arith_emit(prog, LSH_AOP_STORE, 0, name);
+            return;
+        }
+    }
+    lsh_arith_emit(prog, LSH_AOP_LOAD, 0, name);
+}
+
+void lsh_arith_expr(struct lsh_arith_parser *ps, int minpower){
+    struct lsh_arith_prog *prog = ps->prog;
+    struct lsh_arith_binop *binop;
+    int i, jump, skip;
+
+    lsh_arith_operand(ps);
+    while(!ps->error){
+        lsh_arith_space(ps);
+        binop = NULL;
+        for(i = 0; i < (int)(sizeof(lsh_arith_binops) / sizeof(lsh_arith_binops[0])); i++){
+            if(strncmp(ps->p, lsh_arith_binops[i].str, strlen(lsh_arith_binops[i].str)) == 0){
+                binop = &lsh_arith_binops[i];
+                break;
+            }
+        }
+        if(binop == NULL || binop->power <= minpower){
+            return;
+        }
+        ps->p += strlen(binop->str);
+
+        switch(binop->op){
+        case LSH_AOP_ANDJ:
+        case LSH_AOP_ORJ:       //short circuit: the right side is jumped over
+            jump = lsh_arith_emit(prog, binop->op, 0, NULL);
+            lsh_arith_expr(ps, binop->power);
+            lsh_arith_emit(prog, LSH_AOP_BOOL, 0, NULL);
+            prog->code[jump].target = prog->len;
+            break;
+        case LSH_AOP_JZ:        //cond ? a : b
+            jump = lsh_arith_emit(prog, LSH_AOP_JZ, 0, NULL);
+            lsh_arith_expr(ps, 1);
+            skip = lsh_arith_emit(prog, LSH_AOP_JMP, 0, NULL);
+            prog->depth--;      //only one of the two sides ends up on the stack
+            prog->code[jump].target = prog->len;
+            if(!lsh_arith_accept(ps, ":")){
+                ps->error = 1;
+                return;
+            }
+            lsh_arith_expr(ps, binop->power - 1);
+            prog->code[skip].target = prog->len;
+            break;
+        case LSH_AOP_POP:
+            lsh_arith_emit(prog, LSH_AOP_POP, 0, NULL);
+            lsh_arith_expr(ps, binop->power);
+            break;
+        default:
+            lsh_arith_expr(ps, binop->op == LSH_AOP_POW ? binop->power - 1 : binop->power);
+            lsh_arith_emit(prog, binop->op, 0, NULL);
+        }
+    }
+}
+
+void lsh_arith_free(struct lsh_arith_prog *prog){
+    int i;
+
+    for(i = 0; i < prog->len; i++){
+        free(prog->code[i].name);
+    }
+    free(prog->code);
+    free(prog->text);
+    free(prog);
+}
+
+struct lsh_arith_prog *lsh_arith_compile(const char *text){
+    struct lsh_arith_prog *prog = calloc(1, sizeof(*prog));
+    struct lsh_arith_parser ps = {text, prog, 0};
+
+    if(!prog || !(prog->text = strdup(text))){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    lsh_arith_space(&ps);
+    if(*ps.p == '\0'){
+        lsh_arith_emit(prog, LSH_AOP_NUM, 0, NULL);     //an empty expression is 0
+    }
+    else{
+        lsh_arith_expr(&ps, 0);
+    }
+    if(ps.error || *ps.p != '\0'){
+        fprintf(stderr, "lsh: %s: syntax error in expression (error token is \"%s\")\n", text, *ps.p ? ps.p : text);
+        lsh_arith_free(prog);
+        return NULL;
+    }
+    return prog;
+}
+
+long long lsh_arith_load(const char *name){
+    char *value = lsh_getvar(name, strlen(name));
+
+    return value ? strtoll(value, NULL, 0) : 0;
+}
+
+void lsh_arith_store(const char *name, long long value){
+    char number[32];
+
+    snprintf(number, sizeof(number), "%lld", value);
+    lsh_setvar(name, number, 0);
+}
+
+//run a program, it returns 0 and leaves the result in *result, or -1 on a division by zero.
+int lsh_arith_run(struct lsh_arith_prog *prog, long long *result){
+    long long stack[LSH_ARITH_STACK], *sp = stack, a, b, r;
+    unsigned long long u, base;
+    struct lsh_arith_insn *insn;
+    int pc;
+
+    if(prog->maxdepth > LSH_ARITH_STACK){
+        fprintf(stderr, "lsh: %s: expression too complex\n", prog->text);
+        return -1;
+    }
+    for(pc = 0; pc < prog->len; pc++){
+        insn = &prog->code[pc];
+        switch(insn->op){
+        case LSH_AOP_NUM: *sp++ = insn->value; break;
+        case LSH_AOP_LOAD: *sp++ = lsh_arith_load(insn->name); break;
+        case LSH_AOP_STORE: lsh_arith_store(insn->name, sp[-1]); break;
+        case LSH_AOP_PREINC:
+        case LSH_AOP_POSTINC:
+            a = lsh_arith_load(insn->name);
+            lsh_arith_store(insn->name, a + insn->value);
+            *sp++ = insn->op == LSH_AOP_PREINC ? a + insn->value : a;
+            break;
+        case LSH_AOP_NEG: sp[-1] = -sp[-1]; break;
+        case LSH_AOP_NOT: sp[-1] = !sp[-1]; break;
+        case LSH_AOP_BITNOT: sp[-1] = ~sp[-1]; break;
+        case LSH_AOP_BOOL: sp[-1] = sp[-1] != 0; break;
+        case LSH_AOP_POP: sp--; break;
+        case LSH_AOP_JMP: pc = insn->target - 1; break;
+        case LSH_AOP_JZ:
+            if(*--sp == 0){
+                pc = insn->target - 1;
+            }
+            break;
+        case LSH_AOP_ANDJ:
+        case LSH_AOP_ORJ:
+            if((sp[-1] != 0) == (insn->op == LSH_AOP_ORJ)){
+                sp[-1] = sp[-1] != 0;
+                pc = insn->target - 1;
+            }
+            else{
+                sp--;
+            }
+            break;
+        default:        //the binary operators
+            b = *--sp;
+            a = sp[-1];
+            switch(insn->op){
+            case LSH_AOP_ADD: r = a + b; break;
+            case LSH_AOP_SUB: r = a - b; break;
+            case LSH_AOP_MUL: r = a * b; break;
+            case LSH_AOP_DIV:
+            case LSH_AOP_MOD:
+                if(b == 0){
+                    fprintf(stderr, "lsh: %s: division by 0\n", prog->text);
+                    return -1;
+                }
+                if(a == LLONG_MIN && b == -1){
+                    r = insn->op == LSH_AOP_DIV ? LLONG_MIN : 0;       //what it wraps around to, C would trap
+                }
+                else{
+                    r = insn->op == LSH_AOP_DIV ? a / b : a % b;
+                }
+                break;
+            case LSH_AOP_POW:
+                if(b < 0){
+                    fprintf(stderr, "lsh: %s: exponent less than 0\n", prog->text);
+                    return -1;
+                }
+                for(u = 1, base = a; b > 0; b >>= 1, base *= base){     //by squaring, in unsigned so it wraps around
+                    if(b & 1){
+                        u *= base;
+                    }
+                }
+                r = (long long)u;
+                break;
+            case LSH_AOP_SHL:
+            case LSH_AOP_SHR:
+                if(b < 0 || b > 63){
+                    fprintf(stderr, "lsh: %s: shift count out of range\n", prog->text);
+                    return -1;
+                }
+                r = insn->op == LSH_AOP_SHL ? (long long)((unsigned long long)a << b) : a >> b;
+                break;
+            case LSH_AOP_LT: r = a < b; break;
+            case LSH_AOP_LE: r = a <= b; break;
+            case LSH_AOP_GT: r = a > b; break;
+            case LSH_AOP_GE: r = a >= b; break;
+            case LSH_AOP_EQ: r = a == b; break;
+            case LSH_AOP_NE: r = a != b; break;
+            case LSH_AOP_AND: r = a & b; break;
+            case LSH_AOP_XOR: r = a ^ b; break;
+            default: r = a | b; break;
+            }
+            sp[-1] = r;
+        }
+    }
+    *result = sp[-1];
+    return 0;
+}
+
+/*
+function: lsh_arith
+evaluate an expression, it returns 0 on success and -1 (with lsh_last_status set to 1) if the expression is wrong.
+cache is 0 for a text that came out of expanding $ references.
+*/
+int lsh_arith(const char *text, int cache, long long *result){
+    struct lsh_arith_prog *prog, **link;
+    unsigned int bucket;
+    int ret, n;
+
+    *result = 0;
+    bucket = lsh_hash(text, strlen(text)) % LSH_ARITH_BUCKETS;
+    for(prog = lsh_arith_cache[bucket]; prog != NULL; prog = prog->next){
+        if(strcmp(prog->text, text) == 0){
+            break;
+        }
+    }
+    if(prog == NULL){
+        prog = lsh_arith_compile(text);
+        if(prog == NULL){
+            lsh_last_status = 1;
+            return -1;
+        }
+        cache = cache && strchr(text, '$') == NULL;
+        if(cache){
+            for(n = 1, link = &lsh_arith_cache[bucket]; *link != NULL && n < LSH_ARITH_CHAIN; n++){
+                link = &(*link)->next;
+            }
+            if(*link != NULL){
+                lsh_arith_free(*link);      //the oldest, it is the last one
+                *link = NULL;
+            }
+            prog->next = lsh_arith_cache[bucket];
+            lsh_arith_cache[bucket] = prog;
+        }
+    }
+    else{
+        cache = 1;
+    }
+    ret = lsh_arith_run(prog, result);
+    if(!cache){
+        lsh_arith_free(prog);
+    }
+    if(ret != 0){
+        lsh_last_status = 1;
+    }
+    return ret;
+}
+
+//let evaluates each argument as an expression, its status is 0 if the last one was not 0.
+int lsh_let(char** args){
+    long long value = 0;
+    int i;
+
+    if(args[1] == NULL){
+        fprintf(stderr, "lsh: let: expression expected\n");
+        lsh_last_status = 1;
+        return 1;
+    }
+    for(i = 1; args[i] != NULL; i++){
+        if(lsh_arith(args[i], 1, &value) != 0){
+            return 1;
+        }
+    }
+    lsh_last_status = value == 0;
+    return 1;
+}
+
+/*
+right before a command runs, its words are expanded: {a,b} and {1..N} braces are expanded, $name and $(...) are replaced
+by the value of the variable or the output of the command inside, the result is split into separate words on whitespace
+unless it was quoted, and the quotes are removed.
+*/
+int lsh_run_text(char *text, int subshell);
+
+/*
+function: lsh_command_subst
+run a command line and capture its output. the command's stdout is a memfd, so an external command writes straight
+into it and we don't shuttle its output through small read() calls and a string we keep realloc'ing: once it is done
+we know the exact size, take one block of that size from the arena and pull everything in with pread().
+the command line is a subshell, like "( ... )": it runs right here in the shell process with stdout pointed at the
+memfd and what it changes is put back afterwards, only a line that defines functions or aliases, or starts jobs,
+forks (see lsh_exec_subshell()).
+the trailing newlines are cut off in place.
+*/
+char *lsh_command_subst(const char *cmd, size_t cmdlen, size_t *outlen){
+    char *out;
+    int fd, saved_out;
+    struct stat st;
+    ssize_t n;
+    size_t len = 0;
+
+    *outlen = 0;
+    fd = memfd_create("lsh-subst", MFD_CLOEXEC);
+    if(fd < 0){
+        perror("lsh");
+        return "";
+    }
+
+    fflush(stdout);
+    saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    if(saved_out < 0 && errno != EBADF){
+        perror("lsh");      //we couldn't put our stdout back afterwards
+        close(fd);
+        return "";
+    }
+    dup2(fd, STDOUT_FILENO);
+    lsh_run_text(lsh_arena_strndup(cmd, cmdlen), 1);        //an "exit" in here only ends the substitution
+    fflush(stdout);
+    if(saved_out >= 0){
+        dup2(saved_out, STDOUT_FILENO);
+        close(saved_out);
+    }
+    else{
+        close(STDOUT_FILENO);       //it was closed before, and stays so
+    }
+
+    if(fstat(fd, &st) != 0){
+        perror("lsh");
+        close(fd);
+        return "";
+    }
+    out = lsh_arena_alloc(st.st_size + 1);
+    while(len < (size_t)st.st_size && (n = pread(fd, out + len, st.st_size - len, len)) > 0){
+        len += n;
+    }
+    close(fd);
+
+    while(len > 0 && out[len - 1] == '\n'){
+        len--;
+    }
+    out[len] = '\0';
+    *outlen = len;
+    return out;
+}
+
+/*
+brace expansion turns "a{b,c}d" into "abd acd" and "{1..5}" into "1 2 3 4 5", a range can have a step ("{1..9..2}") and
+zero padding ("{01..10}"), and letters work too ("{a..e}"). braces nest, and several of them in one word multiply.
+
+a word with braces is parsed into a small tree, and the words are generated one at a time like the digits of an
+odometer: the rightmost brace turns fastest, and when it wraps around the one to its left moves on. so "{1..1000000}"
+costs a few counters, not a million strings, a "for" loop pulls one word, runs its body and pulls the next.
+*/
+enum{
+    LSH_BRACE_TEXT,     //plain text
+    LSH_BRACE_SEQ,      //parts that are glued together
+    LSH_BRACE_ALT,      //{a,b,c}: one of the kids at a time
+    LSH_BRACE_RANGE     //{x..y..step}
+};
+
+struct lsh_brace{
+    int type;
+    const char *text;
+    size_t len;
+    struct lsh_brace **kids;
+    int nkids, cur;
+    long long start, end, step, value;
+    int width, letters;
+};
+
+struct lsh_brace *lsh_brace_new(int type){
+    struct lsh_brace *b = lsh_arena_alloc(sizeof(*b));
+
+    memset(b, 0, sizeof(*b));
+    b->type = type;
+    return b;
+}
+
+void lsh_brace_add(struct lsh_brace *b, struct lsh_brace *kid){
+    struct lsh_brace **kids;
+
+    if((b->nkids & (b->nkids - 1)) == 0){       //grow the array whenever the count reaches a power of two
+        kids = lsh_arena_alloc((b->nkids ? b->nkids * 2 : 1) * sizeof(*kids));
+        if(b->nkids > 0){
+            memcpy(kids, b->kids, b->nkids * sizeof(*kids));
+        }
+        b->kids = kids;
+    }
+    b->kids[b->nkids++] = kid;
+}
+
+//one end of a range: a number (and how many digits it has if it is zero padded) or a single letter.
+int lsh_range_end(const char *p, const char *end, long long *value, int *width, int *letter){
+    char *stop;
+
+    if(end - p == 1 && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z'))){
+        *value = *p;
+        *letter = 1;
+        return 1;
+    }
+    *value = strtoll(p, &stop, 10);
+    *letter = 0;
+    if(stop != end || p == end){
+        return 0;
+    }
+    if(*p == '-' || *p == '+'){
+        p++;
+    }
+    *width = (*p == '0' && end - p > 1) ? (int)(end - p) : 0;
+    return 1;
+}
+
+struct lsh_brace *lsh_brace_range(const char *p, const char *close){
+    struct lsh_brace *b = lsh_brace_new(LSH_BRACE_RANGE);
+    const char *dots = strstr(p, ".."), *dots2;
+    int w1 = 0, w2 = 0, w3 = 0, l1, l2, l3 = 0;
+    long long step = 1;
+
+    if(dots == NULL || dots > close){
+        return NULL;
+    }
+    dots2 = strstr(dots + 2, "..");
+    if(dots2 != NULL && dots2 < close){
+        if(!lsh_range_end(dots2 + 2, close, &step, &w3, &l3) || l3 || step == 0){
+            return NULL;
+        }
+    }
+    else{
+        dots2 = close;
+    }
+    if(!lsh_range_end(p, dots, &b->start, &w1, &l1) || !lsh_range_end(dots + 2, dots2, &b->end, &w2, &l2) || l1 != l2){
+        return NULL;
+    }
+    b->step = step < 0 ? -step : step;
+    if(b->start > b->end){
+        b->step = -b->step;
+    }
+    b->value = b->start;
+    b->width = w1 > w2 ? w1 : w2;
+    b->letters = l1;
+    return b;
+}
+
+/*
+parse text up to the end of the word, or in a brace up to the ',' or '}' that ends this alternative.
+quoted text, escaped characters and ${...} are never looked into.
+*/
+struct lsh_brace *lsh_brace_seq(const char **pp, int in_brace);
+
+struct lsh_brace *lsh_brace_alt(const char **pp){
+    struct lsh_brace *b = lsh_brace_new(LSH_BRACE_ALT), *range;
+    const char *p = *pp + 1, *close;
+
+    //a range has nothing but its two ends (and a step) in the braces
+    close = strchr(p, '}');
+    if(close != NULL && (range = lsh_brace_range(p, close)) != NULL){
+        *pp = close + 1;
+        return range;
+    }
+
+    lsh_brace_add(b, lsh_brace_seq(&p, 1));
+    while(*p == ','){
+        p++;
+        lsh_brace_add(b, lsh_brace_seq(&p, 1));
+    }
+    if(*p != '}' || b->nkids < 2){
+        return NULL;        //"{a}" or an unclosed brace is just text
+    }
+    *pp = p + 1;
+    return b;
+}
+
+struct lsh_brace *lsh_brace_seq(const char **pp, int in_brace){
+    struct lsh_brace *seq = lsh_brace_new(LSH_BRACE_SEQ), *text, *alt;
+    const char *p = *pp, *start = p, *end, *q;
+    int dquote = 0;
+
+    while(*p != '\0' && !(in_brace && !dquote && (*p == ',' || *p == '}'))){
+        if(*p == '\\' && p[1] != '\0'){
+            p += 2;
+        }
+        else if(*p == '\'' && !dquote && (end = strchr(p + 1, '\'')) != NULL){
+            p = end + 1;
+        }
+        else if(*p == '"'){
+            dquote = !dquote;
+            p++;
+        }
+        else if(*p == '$' && p[1] == '{' && (end = strchr(p, '}')) != NULL){
+            p = end + 1;
+        }
+        else if(*p == '$' && p[1] == '(' && (end = lsh_match_paren(p + 2)) != NULL){
+            p = end + 1;
+        }
+        else if(*p == '{' && !dquote && (q = p, alt = lsh_brace_alt(&q)) != NULL){
+            if(p > start){
+                text = lsh_brace_new(LSH_BRACE_TEXT);
+                text->text = start;
+                text->len = p - start;
+                lsh_brace_add(seq, text);
+            }
+            lsh_brace_add(seq, alt);
+            p = start = q;
+        }
+        else{
+            p++;
+        }
+    }
+    if(p > start || seq->nkids == 0){
+        text = lsh_brace_new(LSH_BRACE_TEXT);
+        text->text = start;
+        text->len = p - start;
+        lsh_brace_add(seq, text);
+    }
+    *pp = p;
+    return seq;
+}
+
+//the tree for a word, or NULL if the word has nothing to expand.
+struct lsh_brace *lsh_brace_parse(const char *word){
+    struct lsh_brace *seq;
+    int i;
+
+    if(strchr(word, '{') == NULL){
+        return NULL;
+    }
+    seq = lsh_brace_seq(&word, 0);
+    for(i = 0; i < seq->nkids; i++){
+        if(seq->kids[i]->type != LSH_BRACE_TEXT){
+            return seq;
+        }
+    }
+    return NULL;
+}
+
+//append the word the tree stands for right now.
+void lsh_brace_emit(struct lsh_brace *b, struct lsh_str *out){
+    char number[32];
+    int i, n;
+
+    switch(b->type){
+    case LSH_BRACE_TEXT:
+        lsh_str_append(out, b->text, b->len);
+        break;
+    case LSH_BRACE_SEQ:
+        for(i = 0; i < b->nkids; i++){
+            lsh_brace_emit(b->kids[i], out);
+        }
+        break;
+    case LSH_BRACE_ALT:
+        lsh_brace_emit(b->kids[b->cur], out);
+        break;
+    case LSH_BRACE_RANGE:
+        if(b->letters){
+            number[0] = (char)b->value;
+            n = 1;
+        }
+        else if(b->value < 0){
+            n = snprintf(number, sizeof(number), "-%0*lld", b->width > 0 ? b->width - 1 : 0, -b->value);
+        }
+        else{
+            n = snprintf(number, sizeof(number), "%0*lld", b->width, b->value);
+        }
+        lsh_str_append(out, number, n);
+        break;
+    }
+}
+
+void lsh_brace_reset(struct lsh_brace *b){
+    int i;
+
+    b->cur = 0;
+    b->value = b->start;
+    for(i = 0; i < b->nkids; i++){
+        lsh_brace_reset(b->kids[i]);
+    }
+}
+
+//move on to the next word, it returns 0 (and starts over) once every word has been generated.
+int lsh_brace_next(struct lsh_brace *b){
+    int i;
+
+    switch(b->type){
+    case LSH_BRACE_SEQ:
+        for(i = b->nkids - 1; i >= 0; i--){
+            if(lsh_brace_next(b->kids[i])){
+                return 1;
+            }
+        }
+        return 0;
+    case LSH_BRACE_ALT:
+        if(lsh_brace_next(b->kids[b->cur])){
+            return 1;
+        }
+        b->cur = (b->cur + 1) % b->nkids;
+        lsh_brace_reset(b->kids[b->cur]);
+        return b->cur != 0;
+    case LSH_BRACE_RANGE:
+        if(b->value == b->end || (b->step > 0 ? b->value + b->step > b->end : b->value + b->step < b->end)){
+            b->value = b->start;
+            return 0;
+        }
+        b->value += b->step;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+globbing: a word with an unquoted *, ? or [...] is a pattern, and it is replaced by the sorted list of paths it matches
+(or stays as it is if nothing matches). "**" as a whole path component matches any number of directories.
+
+directories are read with the getdents64 system call straight into a big buffer, which skips the per-entry overhead
+of readdir(). the listing is kept in a small cache keyed by the directory's device, inode and mtime, any change to the
+directory bumps its mtime, so a glob repeated in a loop re-reads nothing as long as the directory stays the same.
+*/
+struct lsh_dirent64{
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+struct lsh_dirlist{
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    char *names;        //all names back to back, each one '\0' terminated
+    unsigned char *types;       //the d_type of each name
+    int count;
+    int pinned;     //a listing that is being walked can't be evicted
+    int cached;
+};
+
+struct lsh_dirlist lsh_dir_cache[LSH_GLOB_CACHE];
+int lsh_dir_cache_next = 0;
+
+void lsh_dirlist_free(struct lsh_dirlist *list){
+    free(list->names);
+    free(list->types);
+    list->names = NULL;
+    list->types = NULL;
+    list->count = 0;
+}
+
+//read all the names of an open directory, '\0' terminated into names and their d_type into types. no "." or "..".
+int lsh_list_dir(int fd, struct lsh_str *names, struct lsh_str *types){
+    struct lsh_dirent64 *ent;
+    char buf[LSH_DENTS_BUFSIZE];
+    long nread, pos;
+    int count = 0;
+
+    while((nread = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0){
+        for(pos = 0; pos < nread; pos += ent->d_reclen){
+            ent = (struct lsh_dirent64 *)(buf + pos);
+            if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0){
+                continue;
+            }
+            lsh_str_append(names, ent->d_name, strlen(ent->d_name) + 1);
+            lsh_str_append(types, (char *)&ent->d_type, 1);
+            count++;
+        }
+    }
+    return count;
+}
+
+struct lsh_dirlist *lsh_read_dir(const char *path){
+    struct lsh_dirlist *list = NULL;
+    struct lsh_str names = {NULL, 0, 0}, types = {NULL, 0, 0};
+    struct stat st;
+    int fd, i, count;
+
+    if(stat(path, &st) != 0 || !S_ISDIR(st.st_mode)){
+        return NULL;
+    }
+    for(i = 0; i < LSH_GLOB_CACHE; i++){
+        list = &lsh_dir_cache[i];
+        if(list->names != NULL && list->dev == st.st_dev && list->ino == st.st_ino
+            && list->mtime.tv_sec == st.st_mtim.tv_sec && list->mtime.tv_nsec == st.st_mtim.tv_nsec){
+            list->pinned++;
+            return list;
+        }
+    }
+
+    fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd < 0 || fstat(fd, &st) != 0){     //key the listing by what we actually read
+        if(fd >= 0){
+            close(fd);
+        }
+        return NULL;
+    }
+    count = lsh_list_dir(fd, &names, &types);
+    close(fd);
+
+    //take the next slot that is not in use, if all of them are (a very deep walk) the listing is just not cached.
+    for(i = 0; i < LSH_GLOB_CACHE && lsh_dir_cache[lsh_dir_cache_next].pinned > 0; i++){
+        lsh_dir_cache_next = (lsh_dir_cache_next + 1) % LSH_GLOB_CACHE;
+    }
+    if(i < LSH_GLOB_CACHE){
+        list = &lsh_dir_cache[lsh_dir_cache_next];
+        lsh_dir_cache_next = (lsh_dir_cache_next + 1) % LSH_GLOB_CACHE;
+        lsh_dirlist_free(list);
+        list->cached = 1;
+    }
+    else{
+        list = malloc(sizeof(*list));
+        if(!list){
+            fprintf(stderr,"lsh: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        list->cached = 0;
+    }
+    list->dev = st.st_dev;
+    list->ino = st.st_ino;
+    list->mtime = st.st_mtim;
+    list->names = names.data ? names.data : calloc(1, 1);       //an empty directory still needs a non-NULL listing
+    list->types = (unsigned char *)types.data;
+    list->count = count;
+    list->pinned = 1;
+    return list;
+}
+
+void lsh_release_dir(struct lsh_dirlist *list){
+    list->pinned--;
+    if(!list->cached){
+        lsh_dirlist_free(list);
+        free(list);
+    }
+}
+
+//match a name against one path component of a pattern, a backslash makes the next character literal.
+int lsh_glob_match(const char *pat, const char *name){
+    const char *star_pat = NULL, *star_name = NULL, *p;
+    int negate, matched;
+
+    while(*name != '\0'){
+        if(*pat == '*'){
+            star_pat = ++pat;       //remember where to come back to if the rest does not match
+            star_name = name;
+            continue;
+        }
+        if(*pat == '?'){
+            pat++;
+            name++;
+            continue;
+        }
+        if(*pat == '[' && (p = strchr(pat + 2, ']')) != NULL){
+            p = pat + 1;
+            negate = (*p == '!' || *p == '^');
+            p += negate;
+            matched = 0;
+            do{     //a ']' right after the '[' is a literal one
+                if(*p == '\\' && p[1] != '\0'){
+                    p++;
+                }
+                if(p[1] == '-' && p[2] != ']' && p[2] != '\0'){
+                    matched |= (unsigned char)*name >= (unsigned char)p[0] && (unsigned char)*name <= (unsigned char)p[2];
+                    p += 3;
+                }
+                else{
+                    matched |= *name == *p;
+                    p++;
+                }
+            }while(*p != ']' && *p != '\0');
+            if(*p == ']' && matched != negate){
+                pat = p + 1;
+                name++;
+                continue;
+            }
+        }
+        else{
+            if(*pat == '\\' && pat[1] != '\0'){
+                pat++;
+            }
+            if(*pat == *name && *pat != '\0'){
+                pat++;
+                name++;
+                continue;
+            }
+        }
+        if(star_pat == NULL){
+            return 0;
+        }
+        pat = star_pat;     //let the last '*' swallow one more character
+        name = ++star_name;
+    }
+    while(*pat == '*'){
+        pat++;
+    }
+    return *pat == '\0';
+}
+
+//does the text have an unescaped *, ? or [ in it?
+int lsh_has_glob(const char *p){
+    for(; *p != '\0'; p++){
+        if(*p == '\\' && p[1] != '\0'){
+            p++;
+        }
+        else if(*p == '*' || *p == '?' || *p == '['){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+struct lsh_glob{
+    struct lsh_str paths;       //the matches back to back, each one '\0' terminated
+    int count;
+};
+
+//path + "/" + name, without doubling the slash of "/" and without a "./" in front of relative paths.
+void lsh_path_join(struct lsh_str *path, const char *name, size_t n){
+    if(path->len > 0 && path->data[path->len - 1] != '/'){
+        lsh_str_append(path, "/", 1);
+    }
+    lsh_str_append(path, name, n);
+}
+
+int lsh_strcmp_ptr(const void *a, const void *b){
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+void lsh_glob_walk(struct lsh_glob *g, struct lsh_str *path, char **comps, int ncomp, int i);
+
+/*
+a "**" over a big tree is the slowest thing a glob can do, so it is spread over a pool of threads.
+
+every directory still to be read is a job. each thread has its own deque of jobs: it pushes the subdirectories it
+finds at the bottom and takes its next job from the bottom too (depth first, which keeps few directories open),
+a thread that runs dry steals from the top of another thread's deque (the oldest jobs, usually the biggest subtrees),
+and when there is nothing to steal it sleeps on a condition variable until a job is pushed or the walk is over.
+a subdirectory is opened with openat() relative to its parent's fd, so the kernel never walks the whole path again,
+the parent's fd stays open until the last of its children has been opened.
+
+what a thread does with the entries depends on what comes after the "**":
+ - nothing: every entry is a match.
+ - one more component: the entries that match it are the results, straight from the listing.
+ - more than that: the thread only collects directories, and the rest of the pattern is walked over them afterwards.
+each thread collects its results into its own buffer and lsh_glob() sorts them all in the end, so the order of the
+output never depends on how the threads were scheduled.
+*/
+enum { LSH_WALK_ALL, LSH_WALK_MATCH, LSH_WALK_DIRS };
+
+struct lsh_walk_node{       //an open directory whose children may still need its fd
+    int fd;
+    atomic_int refs;
+};
+
+struct lsh_walk_job{
+    struct lsh_walk_node *parent;
+    char *path;     //the path as it is printed, path + name_off is the name to open in the parent
+    size_t name_off;
+};
+
+struct lsh_walk_deque{
+    pthread_mutex_t lock;
+    struct lsh_walk_job *jobs;
+    int top, bottom, cap;
+};
+
+struct lsh_walker{
+    struct lsh_walk_deque deques[LSH_GLOB_MAX_THREADS];
+    struct lsh_glob results[LSH_GLOB_MAX_THREADS];
+    int nthreads, mode;
+    const char *comp;       //the component after "**" in LSH_WALK_MATCH mode
+    atomic_long pending;        //jobs queued or being worked on, the walk is over when it drops to 0
+    atomic_long posted;     //jobs pushed so far, an idle thread sleeps until this changes or pending is 0
+    atomic_int idle;        //threads asleep, or about to be, on wake
+    pthread_mutex_t idle_lock;
+    pthread_cond_t wake;
+};
+
+struct lsh_walk_arg{
+    struct lsh_walker *w;
+    int id;
+};
+
+void lsh_walk_push(struct lsh_walker *w, int id, struct lsh_walk_job job){
+    struct lsh_walk_deque *dq = &w->deques[id];
+
+    atomic_fetch_add(&w->pending, 1);
+    pthread_mutex_lock(&dq->lock);
+    if(dq->bottom == dq->cap){
+        if(dq->top > 0){        //slide the live jobs down before growing
+            memmove(dq->jobs, dq->jobs + dq->top, (dq->bottom - dq->top) * sizeof(job));
+            dq->bottom -= dq->top;
+            dq->top = 0;
+        }
+        if(dq->bottom == dq->cap){
+            dq->cap = dq->cap ? dq->cap * 2 : LSH_TOK_BUFSIZE;
+            dq->jobs = realloc(dq->jobs, dq->cap * sizeof(job));
+            if(!dq->jobs){
+                fprintf(stderr,"lsh: allocation error\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    dq->jobs[dq->bottom++] = job;
+    pthread_mutex_unlock(&dq->lock);
+    atomic_fetch_add(&w->posted, 1);
+    if(atomic_load(&w->idle) > 0){      //a thread that went idle after this sees posted changed, or is woken here
+        pthread_mutex_lock(&w->idle_lock);
+        pthread_cond_signal(&w->wake);
+        pthread_mutex_unlock(&w->idle_lock);
+    }
+}
+
+//the owner takes from the bottom, a thief from the top.
+int lsh_walk_take(struct lsh_walker *w, int id, int steal, struct lsh_walk_job *job){
+    struct lsh_walk_deque *dq = &w->deques[id];
+    int found = 0;
+
+    pthread_mutex_lock(&dq->lock);
+    if(dq->top < dq->bottom){
+        *job = steal ? dq->jobs[dq->top++] : dq->jobs[--dq->bottom];
+        found = 1;
+    }
+    if(dq->top == dq->bottom){
+        dq->top = dq->bottom = 0;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+void lsh_walk_release(struct lsh_walk_node *node){
+    if(node != NULL && atomic_fetch_sub(&node->refs, 1) == 1){
+        close(node->fd);
+        free(node);
+    }
+}
+
+void lsh_walk_result(struct lsh_glob *r, const char *path){
+    lsh_str_append(&r->paths, path, strlen(path) + 1);
+    r->count++;
+}
+
+void lsh_walk_dir(struct lsh_walker *w, int id, struct lsh_walk_job *job){
+    struct lsh_glob *r = &w->results[id];
+    struct lsh_walk_node *node;
+    struct lsh_walk_job child;
+    struct lsh_dirent64 *ent;
+    struct lsh_str path = {NULL, 0, 0};
+    struct stat st;
+    char buf[LSH_DENTS_BUFSIZE];
+    long nread, pos;
+    int fd, isdir;
+
+    fd = openat(job->parent ? job->parent->fd : AT_FDCWD, job->path[0] ? job->path + job->name_off : ".",
+        O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    lsh_walk_release(job->parent);
+    if(fd < 0){
+        free(job->path);
+        return;
+    }
+    node = malloc(sizeof(*node));
+    if(!node){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    node->fd = fd;
+    atomic_init(&node->refs, 1);
+
+    if(w->mode == LSH_WALK_DIRS){
+        lsh_walk_result(r, job->path);
+    }
+    lsh_str_append(&path, job->path, strlen(job->path));
+    while((nread = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0){
+        for(pos = 0; pos < nread; pos += ent->d_reclen){
+            ent = (struct lsh_dirent64 *)(buf + pos);
+            if(ent->d_name[0] == '.' && (w->mode != LSH_WALK_MATCH || w->comp[0] != '.'
+                || strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)){
+                continue;       //hidden entries are neither matched nor descended into
+            }
+            path.len = strlen(job->path);
+            lsh_path_join(&path, ent->d_name, strlen(ent->d_name));
+
+            if(w->mode == LSH_WALK_ALL || (w->mode == LSH_WALK_MATCH && lsh_glob_match(w->comp, ent->d_name))){
+                lsh_walk_result(r, path.data);
+            }
+            isdir = ent->d_type == DT_DIR;
+            if(ent->d_type == DT_UNKNOWN){
+                isdir = fstatat(fd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+            }
+            if(isdir && ent->d_name[0] != '.'){
+                atomic_fetch_add(&node->refs, 1);
+                child.parent = node;
+                child.path = strdup(path.data);
+                child.name_off = path.len - strlen(ent->d_name);
+                if(!child.path){
+                    fprintf(stderr,"lsh: allocation error\n");
+                    exit(EXIT_FAILURE);
+                }
+                lsh_walk_push(w, id, child);
+            }
+        }
+    }
+    lsh_walk_release(node);
+    free(path.data);
+    free(job->path);
+}
+
+//a job is done. the last one wakes everybody up to leave.
+void lsh_walk_done(struct lsh_walker *w){
+    if(atomic_fetch_sub(&w->pending, 1) == 1){
+        pthread_mutex_lock(&w->idle_lock);
+        pthread_cond_broadcast(&w->wake);
+        pthread_mutex_unlock(&w->idle_lock);
+    }
+}
+
+void *lsh_walk_worker(void *arg){
+    struct lsh_walker *w = ((struct lsh_walk_arg *)arg)->w;
+    int id = ((struct lsh_walk_arg *)arg)->id, i;
+    struct lsh_walk_job job;
+    long seen;
+
+    for(;;){
+        seen = atomic_load(&w->posted);     //before looking, so a job pushed meanwhile isn't slept through
+        if(lsh_walk_take(w, id, 0, &job)){
+            lsh_walk_dir(w, id, &job);
+            lsh_walk_done(w);
+            continue;
+        }
+        for(i = 1; i < w->nthreads; i++){
+            if(lsh_walk_take(w, (id + i) % w->nthreads, 1, &job)){
+                break;
+            }
+        }
+        if(i < w->nthreads){
+            lsh_walk_dir(w, id, &job);
+            lsh_walk_done(w);
+            continue;
+        }
+        //someone is still reading a directory that may give us work, sleep until it pushes some or all is done
+        atomic_fetch_add(&w->idle, 1);
+        pthread_mutex_lock(&w->idle_lock);
+        while(atomic_load(&w->posted) == seen && atomic_load(&w->pending) != 0){
+            pthread_cond_wait(&w->wake, &w->idle_lock);
+        }
+        pthread_mutex_unlock(&w->idle_lock);
+        atomic_fetch_sub(&w->idle, 1);
+        if(atomic_load(&w->pending) == 0){
+            break;
+        }
+    }
+    return NULL;
+}
+
+//expand comps[i] == "**" below path with nthreads threads (the calling thread is one of them).
+void lsh_glob_parallel(struct lsh_glob *g, struct lsh_str *path, char **comps, int ncomp, int i, int nthreads){
+    struct lsh_walker *w;
+    struct lsh_walk_arg args[LSH_GLOB_MAX_THREADS];
+    struct lsh_walk_job job;
+    pthread_t threads[LSH_GLOB_MAX_THREADS];
+    struct lsh_glob dirs = {{NULL, 0, 0}, 0};
+    struct lsh_str sub = {NULL, 0, 0};
+    char **sorted, *p;
+    int t, k, started;
+
+    w = calloc(1, sizeof(*w));
+    if(!w){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    w->nthreads = nthreads;
+    w->mode = (i == ncomp - 1) ? LSH_WALK_ALL : (i == ncomp - 2 && strcmp(comps[i + 1], "**") != 0) ? LSH_WALK_MATCH : LSH_WALK_DIRS;
+    w->comp = comps[i + 1 < ncomp ? i + 1 : i];
+    atomic_init(&w->pending, 0);
+    atomic_init(&w->posted, 0);
+    atomic_init(&w->idle, 0);
+    pthread_mutex_init(&w->idle_lock, NULL);
+    pthread_cond_init(&w->wake, NULL);
+    for(t = 0; t < nthreads; t++){
+        pthread_mutex_init(&w->deques[t].lock, NULL);
+    }
+
+    job.parent = NULL;
+    job.path = strdup(path->data);
+    job.name_off = 0;
+    if(!job.path){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    lsh_walk_push(w, 0, job);
+
+    for(started = 1; started < nthreads; started++){
+        args[started].w = w;
+        args[started].id = started;
+        if(pthread_create(&threads[started], NULL, lsh_walk_worker, &args[started]) != 0){
+            break;      //fewer threads just means a slower walk
+        }
+    }
+    args[0].w = w;
+    args[0].id = 0;
+    lsh_walk_worker(&args[0]);
+    for(t = 1; t < started; t++){
+        pthread_join(threads[t], NULL);
+    }
+
+    for(t = 0; t < nthreads; t++){
+        if(w->mode == LSH_WALK_DIRS){
+            lsh_str_append(&dirs.paths, w->results[t].paths.data ? w->results[t].paths.data : "", w->results[t].paths.len);
+            dirs.count += w->results[t].count;
+        }
+        else{
+            lsh_str_append(&g->paths, w->results[t].paths.data ? w->results[t].paths.data : "", w->results[t].paths.len);
+            g->count += w->results[t].count;
+        }
+        free(w->results[t].paths.data);
+        free(w->deques[t].jobs);
+        pthread_mutex_destroy(&w->deques[t].lock);
+    }
+    pthread_mutex_destroy(&w->idle_lock);
+    pthread_cond_destroy(&w->wake);
+    free(w);
+
+    if(dirs.count > 0){
+        //walk the rest of the pattern over the directories "**" matched, in sorted order.
+        sorted = malloc(dirs.count * sizeof(char*));
+        if(!sorted){
+            fprintf(stderr,"lsh: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        for(k = 0, p = dirs.paths.data; k < dirs.count; k++, p += strlen(p) + 1){
+            sorted[k] = p;
+        }
+        qsort(sorted, dirs.count, sizeof(char*), lsh_strcmp_ptr);
+        for(k = 0; k < dirs.count; k++){
+            sub.len = 0;
+            lsh_str_append(&sub, sorted[k], strlen(sorted[k]));
+            lsh_glob_walk(g, &sub, comps, ncomp, i + 1);
+        }
+        free(sorted);
+        free(sub.data);
+    }
+    free(dirs.paths.data);
+}
+
+void lsh_glob_walk(struct lsh_glob *g, struct lsh_str *path, char **comps, int ncomp, int i){
+    struct lsh_dirlist *list;
+    struct lsh_str literal = {NULL, 0, 0};
+    size_t base = path->len;
+    const char *name, *c;
+    int k, last = (i == ncomp - 1), globstar, nthreads;
+    unsigned char type;
+    struct stat st;
+
+    if(i == ncomp){
+        lsh_str_append(&g->paths, path->data, path->len + 1);
+        g->count++;
+        return;
+    }
+
+    if(!lsh_has_glob(comps[i])){
+        for(c = comps[i]; *c != '\0'; c++){     //drop the escapes of a plain component
+            if(*c == '\\' && c[1] != '\0'){
+                c++;
+            }
+            lsh_str_append(&literal, c, 1);
+        }
+        lsh_path_join(path, literal.data ? literal.data : "", literal.len);
+        free(literal.data);
+        if(!last || lstat(path->data, &st) == 0){
+            lsh_glob_walk(g, path, comps, ncomp, i + 1);
+        }
+        path->len = base;
+        path->data[base] = '\0';
+        return;
+    }
+
+    globstar = strcmp(comps[i], "**") == 0;
+    nthreads = lsh_glob_threads > 0 ? lsh_glob_threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(globstar && nthreads > 1){
+        lsh_glob_parallel(g, path, comps, ncomp, i, nthreads < LSH_GLOB_MAX_THREADS ? nthreads : LSH_GLOB_MAX_THREADS);
+        return;
+    }
+    if(globstar && !last){
+        lsh_glob_walk(g, path, comps, ncomp, i + 1);        //"**" matching no directory at all
+    }
+
+    list = lsh_read_dir(path->len > 0 ? path->data : ".");
+    if(list == NULL){
+        return;
+    }
+    for(k = 0, name = list->names; k < list->count; k++, name += strlen(name) + 1){
+        if(name[0] == '.' && comps[i][0] != '.'){
+            continue;       //hidden files only match a pattern that starts with a dot
+        }
+        if(!globstar && !lsh_glob_match(comps[i], name)){
+            continue;
+        }
+        lsh_path_join(path, name, strlen(name));
+        type = list->types[k];
+        if(type == DT_UNKNOWN){
+            type = (lstat(path->data, &st) == 0 && S_ISDIR(st.st_mode)) ? DT_DIR : DT_REG;
+        }
+
+        if(globstar){
+            if(last){
+                lsh_str_append(&g->paths, path->data, path->len + 1);
+                g->count++;
+            }
+            if(type == DT_DIR){     //"**" does not follow symlinks, so a link loop can't trap us
+                lsh_glob_walk(g, path, comps, ncomp, i);
+            }
+        }
+        else if(last){
+            lsh_str_append(&g->paths, path->data, path->len + 1);
+            g->count++;
+        }
+        else if(type == DT_DIR || type == DT_LNK){
+            lsh_glob_walk(g, path, comps, ncomp, i + 1);
+        }
+        path->len = base;
+        path->data[base] = '\0';
+    }
+    lsh_release_dir(list);
+}
+
+/*
+function: lsh_glob
+expand a pattern and append the sorted matches to argv, it returns how many there were.
+all matches are copied into a single arena block, only the array of pointers to them is sorted.
+*/
+int lsh_glob(const char *pattern, struct lsh_argv *argv){
+    struct lsh_glob g = {{NULL, 0, 0}, 0};
+    struct lsh_str path = {NULL, 0, 0};
+    char *copy, *comps[LSH_TOK_BUFSIZE], **sorted, *block, *p;
+    int ncomp = 0, i;
+
+    lsh_rc_impure();        //what it finds depends on the disk
+    copy = lsh_arena_strndup(pattern, strlen(pattern));
+    lsh_str_append(&path, "", 0);
+    if(*copy == '/'){
+        lsh_str_append(&path, "/", 1);
+    }
+    for(p = strtok(copy, "/"); p != NULL && ncomp < LSH_TOK_BUFSIZE; p = strtok(NULL, "/")){
+        comps[ncomp++] = p;
+    }
+    if(ncomp > 0){
+        lsh_glob_walk(&g, &path, comps, ncomp, 0);
+    }
+    free(path.data);
+
+    if(g.count > 0){
+        block = lsh_arena_alloc(g.paths.len);
+        memcpy(block, g.paths.data, g.paths.len);
+        sorted = malloc(g.count * sizeof(char*));
+        if(!sorted){
+            fprintf(stderr,"lsh: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        for(i = 0, p = block; i < g.count; i++, p += strlen(p) + 1){
+            sorted[i] = p;
+        }
+        qsort(sorted, g.count, sizeof(char*), lsh_strcmp_ptr);
+        for(i = 0; i < g.count; i++){
+            lsh_argv_push(argv, sorted[i]);
+        }
+        free(sorted);
+    }
+    free(g.paths.data);
+    return g.count;
+}
+
+/*
+completion. Tab completes the word under the cursor: the first word of a command is completed from the programs on
+PATH (and the builtins and functions), any other word, or one with a '/' in it, from the files of its directory.
+if there is a single match it is put in whole, if there are several, as much as they have in common, and a second
+Tab lists them.
+
+thousands of programs are on a PATH, reading all those directories when Tab is pressed would make it lag. so at
+startup a thread reads them into a compressed prefix trie (a radix tree: every edge holds a run of bytes, a node
+only exists where names branch off or end), and hands it over to the shell when it is done. Tab then only walks down
+the trie: the node of the typed prefix knows how many names are below it, and as long as no name ends there and it
+has one child only, the names below all share that child's bytes too. when PATH or one of its directories changes
+a new trie is built the same way, the old one stays in use until then.
+*/
+struct lsh_trie{
+    const char *label;      //the bytes on the edge that leads here
+    size_t len;
+    struct lsh_trie **kids;     //sorted by their first byte
+    int nkids;
+    int count;      //how many names end here or below
+    int terminal;       //a name ends right here
+};
+
+struct lsh_cmd_index{
+    struct lsh_trie root;
+    char *pool;     //all the names back to back, the labels point into it
+    char *path;     //the PATH it was built from
+    struct timespec *mtimes;        //of each directory on that PATH, a new program changes it
+    int ndirs;
+};
+
+struct lsh_cmd_index *lsh_cmd_index = NULL;     //the one Tab uses, only the main thread touches it
+struct lsh_cmd_index *_Atomic lsh_cmd_index_next = NULL;        //a new one the builder thread has finished
+atomic_int lsh_cmd_index_building;
+
+struct lsh_trie *lsh_trie_kid(struct lsh_trie *node, unsigned char c, int *at){
+    int lo = 0, hi = node->nkids;
+
+    while(lo < hi){
+        int mid = (lo + hi) / 2;
+        if((unsigned char)node->kids[mid]->label[0] < c){
+            lo = mid + 1;
+        }
+        else{
+            hi = mid;
+        }
+    }
+    *at = lo;
+    return lo < node->nkids && (unsigned char)node->kids[lo]->label[0] == c ? node->kids[lo] : NULL;
+}
+
+struct lsh_trie *lsh_trie_new(const char *label, size_t len){
+    struct lsh_trie *node = calloc(1, sizeof(*node));
+
+    if(!node){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    node->label = label;
+    node->len = len;
+    return node;
+}
+
+void lsh_trie_put_kid(struct lsh_trie *node, struct lsh_trie *kid, int at){
+    node->kids = realloc(node->kids, (node->nkids + 1) * sizeof(struct lsh_trie *));
+    if(!node->kids){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    memmove(node->kids + at + 1, node->kids + at, (node->nkids - at) * sizeof(struct lsh_trie *));
+    node->kids[at] = kid;
+    node->nkids++;
+}
+
+int lsh_trie_has(struct lsh_trie *node, const char *s);
+
+void lsh_trie_insert(struct lsh_trie *root, const char *s){
+    struct lsh_trie *node = root, *kid, *mid;
+    size_t n = strlen(s), same;
+    int at;
+
+    if(lsh_trie_has(root, s)){
+        return;     //the same name in two directories of PATH
+    }
+    for(;;){
+        node->count++;
+        if(n == 0){
+            node->terminal = 1;
+            return;
+        }
+        kid = lsh_trie_kid(node, s[0], &at);
+        if(kid == NULL){
+            kid = lsh_trie_new(s, n);
+            kid->terminal = 1;
+            kid->count = 1;
+            lsh_trie_put_kid(node, kid, at);
+            return;
+        }
+        for(same = 0; same < kid->len && same < n && kid->label[same] == s[same]; same++){
+        }
+        if(same < kid->len){        //the name leaves the edge halfway, split it there
+            mid = lsh_trie_new(kid->label, same);
+            mid->count = kid->count;
+            kid->label += same;
+            kid->len -= same;
+            lsh_trie_put_kid(mid, kid, 0);
+            node->kids[at] = mid;
+            kid = mid;
+        }
+        s += same;
+        n -= same;
+        node = kid;
+    }
+}
+
+/*
+function: lsh_trie_find
+the node the names starting with prefix are under. the bytes of its edge that come after the prefix go to rest,
+the names below all have them.
+*/
+struct lsh_trie *lsh_trie_find(struct lsh_trie *node, const char *prefix, struct lsh_str *rest){
+    size_t n = strlen(prefix), same;
+    int at;
+
+    while(n > 0){
+        node = lsh_trie_kid(node, prefix[0], &at);
+        if(node == NULL){
+            return NULL;
+        }
+        for(same = 0; same < node->len && same < n && node->label[same] == prefix[same]; same++){
+        }
+        if(same < node->len && same < n){
+            return NULL;
+        }
+        if(same == node->len){
+            prefix += same;
+            n -= same;
+            continue;
+        }
+        lsh_str_append(rest, node->label + same, node->len - same);
+        break;
+    }
+    return node;
+}
+
+int lsh_trie_has(struct lsh_trie *node, const char *s){
+    struct lsh_str rest = {NULL, 0, 0};
+    int has;
+
+    node = lsh_trie_find(node, s, &rest);
+    has = node != NULL && rest.len == 0 && node->terminal;
+    free(rest.data);
+    return has;
+}
+
+//every name below node, each one starting with word.
+void lsh_trie_collect(struct lsh_trie *node, struct lsh_str *word, struct lsh_argv *out){
+    size_t len = word->len;
+    int i;
+
+    if(node->terminal){
+        lsh_argv_push(out, lsh_arena_strndup(word->data, word->len));
+    }
+    for(i = 0; i < node->nkids; i++){
+        lsh_str_append(word, node->kids[i]->label, node->kids[i]->len);
+        lsh_trie_collect(node->kids[i], word, out);
+        word->len = len;
+    }
+}
+
+void lsh_trie_free(struct lsh_trie *node){
+    int i;
+
+    for(i = 0; i < node->nkids; i++){
+        lsh_trie_free(node->kids[i]);
+        free(node->kids[i]);
+    }
+    free(node->kids);
+}
+
+void lsh_cmd_index_free(struct lsh_cmd_index *index){
+    if(index != NULL){
+        lsh_trie_free(&index->root);
+        free(index->pool);
+        free(index->path);
+        free(index->mtimes);
+        free(index);
+    }
+}
+
+/*
+the builder thread. it only gets a copy of PATH and touches nothing of the shell, the names go into a pool first so
+that the labels of the trie can point into it without it moving.
+*/
+void *lsh_cmd_index_build(void *arg){
+    struct lsh_cmd_index *index = calloc(1, sizeof(*index)), *old;
+    struct lsh_str names = {NULL, 0, 0}, types = {NULL, 0, 0}, pool = {NULL, 0, 0};
+    struct stat st;
+    char *dir, *save = NULL, *name, *entry;
+    int fd, count, i, ndirs = 1;
+
+    if(!index){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    index->path = arg;
+    for(name = index->path; *name != '\0'; name++){
+        ndirs += *name == ':';
+    }
+    index->mtimes = calloc(ndirs, sizeof(struct timespec));
+    dir = strdup(index->path);
+    if(!index->mtimes || !dir){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    for(name = strtok_r(dir, ":", &save); name != NULL; name = strtok_r(NULL, ":", &save)){
+        fd = open(name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if(fd < 0){
+            continue;
+        }
+        if(fstat(fd, &st) == 0){
+            index->mtimes[index->ndirs] = st.st_mtim;
+        }
+        index->ndirs++;
+        names.len = types.len = 0;
+        count = lsh_list_dir(fd, &names, &types);
+        for(i = 0, entry = names.data; i < count; entry += strlen(entry) + 1, i++){
+            if(types.data[i] != DT_DIR && faccessat(fd, entry, X_OK, 0) == 0){
+                lsh_str_append(&pool, entry, strlen(entry) + 1);
+            }
+        }
+        close(fd);
+    }
+    free(dir);
+    free(names.data);
+    free(types.data);
+
+    index->pool = pool.data;
+    for(entry = pool.data; entry != NULL && entry < pool.data + pool.len; entry += strlen(entry) + 1){
+        lsh_trie_insert(&index->root, entry);
+    }
+    old = atomic_exchange(&lsh_cmd_index_next, index);
+    lsh_cmd_index_free(old);        //one the shell never picked up
+    atomic_store(&lsh_cmd_index_building, 0);
+    return NULL;
+}
+
+//start building the index in the background, unless that is already going on.
+void lsh_cmd_index_start(void){
+    pthread_t thread;
+    const char *path = getenv("PATH");
+    char *copy;
+
+    if(atomic_exchange(&lsh_cmd_index_building, 1)){
+        return;
+    }
+    copy = strdup(path ? path : "");
+    if(copy == NULL || pthread_create(&thread, NULL, lsh_cmd_index_build, copy) != 0){
+        free(copy);
+        atomic_store(&lsh_cmd_index_building, 0);
+        return;
+    }
+    pthread_detach(thread);
+}
+
+//the newest index there is. if PATH or one of its directories changed since it was built, a new one is started.
+struct lsh_cmd_index *lsh_cmd_index_get(void){
+    struct lsh_cmd_index *next = atomic_exchange(&lsh_cmd_index_next, NULL);
+    const char *path = getenv("PATH");
+    char *dir, *save = NULL, *name;
+    struct stat st;
+    int i = 0, stale = 0;
+
+    if(next != NULL){
+        lsh_cmd_index_free(lsh_cmd_index);
+        lsh_cmd_index = next;
+    }
+    if(lsh_cmd_index == NULL || strcmp(lsh_cmd_index->path, path ? path : "") != 0){
+        stale = 1;
+    }
+    else if((dir = strdup(lsh_cmd_index->path)) != NULL){
+        for(name = strtok_r(dir, ":", &save); !stale && name != NULL; name = strtok_r(NULL, ":", &save)){
+            if(stat(name, &st) == 0 && S_ISDIR(st.st_mode)){
+                stale = i >= lsh_cmd_index->ndirs || st.st_mtim.tv_sec != lsh_cmd_index->mtimes[i].tv_sec
+                        || st.st_mtim.tv_nsec != lsh_cmd_index->mtimes[i].tv_nsec;
+                i++;
+            }
+        }
+        free(dir);
+    }
+    if(stale){
+        lsh_cmd_index_start();
+    }
+    return lsh_cmd_index;
+}
+
+//the number of bytes a and b start with in common.
+size_t lsh_common_prefix(const char *a, const char *b){
+    size_t n = 0;
+
+    while(a[n] != '\0' && a[n] == b[n]){
+        n++;
+    }
+    return n;
+}
+
+//one more name matches: count it and narrow down what all of them have in common (after the n bytes typed).
+void lsh_complete_add(const char *name, size_t n, struct lsh_str *common, int *count, struct lsh_argv *list){
+    if(*count == 0){
+        common->len = 0;
+        lsh_str_append(common, name, strlen(name));
+    }
+    else{
+        common->len = n + lsh_common_prefix(common->data + n, name + n);
+        common->data[common->len] = '\0';
+    }
+    (*count)++;
+    if(list != NULL){
+        lsh_argv_push(list, (char *)name);
+    }
+}
+
+/*
+function: lsh_complete_command
+what the command names starting with word have in common goes to common, the return value is how many there are.
+the names themselves only go to list when it is not NULL.
+*/
+//whether a builtin, function or alias name was counted already, as a program on the PATH or one of the kinds before it.
+int lsh_complete_seen(struct lsh_cmd_index *index, const char *name, int kind){
+    int i;
+
+    if(index != NULL && lsh_trie_has(&index->root, name)){
+        return 1;
+    }
+    for(i = 0; kind > 0 && i < lsh_num_builtis(); i++){
+        if(strcmp(builtin_str[i], name) == 0){
+            return 1;
+        }
+    }
+    return kind > 1 && lsh_findfunc(name) != NULL;
+}
+
+int lsh_complete_command(const char *word, struct lsh_str *common, struct lsh_argv *list){
+    struct lsh_cmd_index *index = lsh_cmd_index_get();
+    struct lsh_trie *node;
+    struct lsh_str rest = {NULL, 0, 0};
+    struct lsh_func *func;
+    struct lsh_alias *alias;
+    size_t n = strlen(word);
+    int count = 0, i;
+
+    lsh_str_append(common, word, n);
+    if(index != NULL && (node = lsh_trie_find(&index->root, word, &rest)) != NULL){
+        if(rest.len > 0){
+            lsh_str_append(common, rest.data, rest.len);
+        }
+        while(!node->terminal && node->nkids == 1){     //only one way down, so every name goes on like this
+            node = node->kids[0];
+            lsh_str_append(common, node->label, node->len);
+        }
+        count = node->count;
+        if(list != NULL){
+            lsh_trie_collect(node, common, list);
+        }
+    }
+    free(rest.data);
+
+    //the builtins and the functions are few, we just look at them all
+    for(i = 0; i < lsh_num_builtis(); i++){
+        if(strncmp(builtin_str[i], word, n) == 0 && !lsh_complete_seen(index, builtin_str[i], 0)){
+            lsh_complete_add(builtin_str[i], n, common, &count, list);
+        }
+    }
+    for(i = 0; i < LSH_FUNC_BUCKETS; i++){
+        for(func = lsh_funcs[i]; func != NULL; func = func->next){
+            if(strncmp(func->name, word, n) == 0 && !lsh_complete_seen(index, func->name, 1)){
+                lsh_complete_add(func->name, n, common, &count, list);
+            }
+        }
+    }
+    for(i = 0; i < LSH_ALIAS_BUCKETS; i++){
+        for(alias = lsh_aliases[i]; alias != NULL; alias = alias->next){
+            if(strncmp(alias->name, word, n) == 0 && !lsh_complete_seen(index, alias->name, 2)){
+                lsh_complete_add(alias->name, n, common, &count, list);
+            }
+        }
+    }
+    return count;
+}
+
+/*
+function: lsh_complete_file
+the same for the files in the directory of word whose names start with its last component. *isdir says whether the
+only match (if there is one) is a directory. the names in the directory listing come from lsh_read_dir(), getdents64.
+*/
+int lsh_complete_file(const char *word, struct lsh_str *common, struct lsh_argv *list, int *isdir){
+    const char *slash = strrchr(word, '/'), *base = slash ? slash + 1 : word, *name;
+    struct lsh_str path = {NULL, 0, 0};
+    struct lsh_dirlist *dir;
+    size_t n = strlen(base);
+    int count = 0, i, type = DT_UNKNOWN;
+    struct stat st;
+
+    lsh_str_append(&path, word, slash ? (size_t)(slash - word + 1) : 0);
+    dir = lsh_read_dir(path.len > 0 ? path.data : ".");
+    lsh_str_append(common, base, n);
+    for(i = 0, name = dir ? dir->names : NULL; dir != NULL && i < dir->count; name += strlen(name) + 1, i++){
+        if(strncmp(name, base, n) == 0 && (name[0] != '.' || base[0] == '.')){      //dot files only if asked for
+            lsh_complete_add(list ? lsh_arena_strndup(name, strlen(name)) : name, n, common, &count, list);
+            type = dir->types[i];
+        }
+    }
+    *isdir = 0;
+    if(count == 1){
+        lsh_str_append(&path, common->data, common->len);
+        *isdir = type == DT_DIR || ((type == DT_LNK || type == DT_UNKNOWN) && stat(path.data, &st) == 0 && S_ISDIR(st.st_mode));
+    }
+    if(dir != NULL){
+        lsh_release_dir(dir);
+    }
+    free(path.data);
+    return count;
+}
+
+//put the completed text in the line, with a backslash in front of what the shell would take as special.
+void lsh_edit_insert_escaped(struct lsh_editor *ed, const char *text, size_t n){
+    size_t i;
+
+    for(i = 0; i < n; i++){
+        if(strchr(" \t\\'\"$|&;()<>*?[]{}`", text[i]) != NULL){
+            lsh_edit_insert(ed, "\\", 1);
+        }
+        lsh_edit_insert(ed, text + i, 1);
+    }
+}
+
+//the matches under the line, in columns, and the prompt and the line again below them.
+void lsh_edit_list(struct lsh_editor *ed, struct lsh_argv *list){
+    size_t width = 0, len;
+    int cols, rows, r, c, i;
+
+    if(list->len > LSH_COMPLETE_LIST){      //a screenful of names helps nobody
+        lsh_edit_move(ed, ed->prompt_width + lsh_text_width(ed->shown.data, ed->shown_pos),
+                      ed->prompt_width + lsh_text_width(ed->shown.data, ed->shown.len));
+        lsh_edit_printf(ed, "\r\n%d possibilities, type some more\r\n", list->len);
+        lsh_edit_redraw(ed);
+        return;
+    }
+    qsort(list->v, list->len, sizeof(char *), lsh_strcmp_ptr);
+    for(i = 0; i < list->len; i++){
+        len = strlen(list->v[i]);
+        width = len > width ? len : width;
+    }
+    width += 2;
+    cols = ed->cols / width > 0 ? ed->cols / width : 1;
+    rows = (list->len + cols - 1) / cols;
+    lsh_edit_move(ed, ed->prompt_width + lsh_text_width(ed->shown.data, ed->shown_pos),
+                  ed->prompt_width + lsh_text_width(ed->shown.data, ed->shown.len));
+    lsh_str_append(&ed->out, "\r\n", 2);
+    for(r = 0; r < rows; r++){
+        for(c = 0; c < cols && (i = c * rows + r) < list->len; c++){        //down the columns, like ls
+            len = strlen(list->v[i]);
+            lsh_str_append(&ed->out, list->v[i], len);
+            if(c + 1 < cols && (c + 1) * rows + r < list->len){
+                while(len++ < width){
+                    lsh_str_append(&ed->out, " ", 1);
+                }
+            }
+        }
+        lsh_str_append(&ed->out, "\r\n", 2);
+    }
+    lsh_edit_redraw(ed);
+}
+
+/*
+function: lsh_edit_complete
+Tab. again is set when the key before was a Tab too, then a word with several matches gets them listed.
+*/
+void lsh_edit_complete(struct lsh_editor *ed, int again){
+    struct lsh_str word = {NULL, 0, 0}, common = {NULL, 0, 0};
+    struct lsh_argv list = {NULL, 0, 0};
+    struct lsh_arena_pos mark = lsh_arena_mark();
+    size_t start, prev, i;
+    int count, command, isdir = 0;
+    char c;
+
+    //back to the blank or operator before the word, an escaped blank is part of it
+    for(start = ed->pos; start > 0; start--){
+        c = ed->buf.data[start - 1];
+        if(strchr(" \t;|&()<>", c) != NULL && !(start >= 2 && ed->buf.data[start - 2] == '\\')){
+            break;
+        }
+    }
+    for(i = start; i < ed->pos; i++){
+        if(ed->buf.data[i] == '\\' && i + 1 < ed->pos){
+            i++;
+        }
+        lsh_str_append(&word, ed->buf.data + i, 1);
+    }
+    lsh_str_append(&word, "", 0);
+
+    //a command name comes first on the line, after an operator, or after "do" and "{"
+    for(prev = start; prev > 0 && (ed->buf.data[prev - 1] == ' ' || ed->buf.data[prev - 1] == '\t'); prev--){
+    }
+    command = prev == 0 || strchr(";|&(", ed->buf.data[prev - 1]) != NULL
+              || (prev >= 2 && strncmp(ed->buf.data + prev - 2, "do", 2) == 0 && (prev == 2 || ed->buf.data[prev - 3] == ' '))
+              || (ed->buf.data[prev - 1] == '{' && (prev == 1 || ed->buf.data[prev - 2] == ' '));
+
+    if(command && strchr(word.data, '/') == NULL){
+        count = lsh_complete_command(word.data, &common, again ? &list : NULL);
+        i = word.len;
+    }
+    else{
+        count = lsh_complete_file(word.data, &common, again ? &list : NULL, &isdir);
+        i = strrchr(word.data, '/') ? strlen(strrchr(word.data, '/') + 1) : word.len;
+    }
+
+    if(common.len > i){
+        lsh_edit_insert_escaped(ed, common.data + i, common.len - i);
+    }
+    if(count == 1){
+        lsh_edit_insert(ed, isdir ? "/" : " ", 1);
+    }
+    else if(count > 1 && common.len == i && again){
+        lsh_edit_list(ed, &list);
+    }
+    else if(count == 0 || common.len == i){
+        lsh_str_append(&ed->out, "\a", 1);      //nothing to add, ring the bell
+    }
+    free(word.data);
+    free(common.data);
+    free(list.v);
+    lsh_arena_release(mark);
+}
+
+/*
+while a word is expanded we build two strings: the text of the word, and the same text as a glob pattern in which
+the characters that were quoted are escaped, so '*' or "*" stays a literal star.
+*/
+struct lsh_field{
+    struct lsh_str text, pattern;
+    int have, glob;
+};
+
+void lsh_field_append(struct lsh_field *f, const char *s, size_t n, int quoted){
+    size_t i;
+
+    lsh_str_append(&f->text, s, n);
+    for(i = 0; i < n; i++){
+        if(strchr("*?[", s[i]) != NULL){
+            if(quoted){
+                lsh_str_append(&f->pattern, "\\", 1);
+            }
+            else{
+                f->glob = 1;
+            }
+        }
+        else if(s[i] == '\\'){
+            lsh_str_append(&f->pattern, "\\", 1);
+        }
+        lsh_str_append(&f->pattern, s + i, 1);
+    }
+    f->have = 1;
+}
+
+void lsh_field_end(struct lsh_field *f, struct lsh_argv *argv){
+    if(!f->glob || lsh_glob(f->pattern.data, argv) == 0){
+        lsh_argv_push(argv, lsh_arena_strndup(f->text.data ? f->text.data : "", f->text.len));
+    }
+    f->text.len = 0;
+    f->pattern.len = 0;
+    f->have = 0;
+    f->glob = 0;
+}
+
+void lsh_expand_word(const char *p, struct lsh_argv *argv, int split);
+
+/*
+function: lsh_arith_subst
+the value of $((expr)) as a string in the arena. the expression gets its $ references and $(...) expanded first.
+*/
+char *lsh_arith_subst(const char *expr, size_t len, size_t *outlen){
+    struct lsh_argv expanded = {NULL, 0, 0};
+    char *text = lsh_arena_strndup(expr, len), number[32];
+    long long value;
+    int cache = strchr(text, '$') == NULL;
+
+    if(!cache){
+        lsh_expand_word(text, &expanded, 0);
+        text = expanded.v[0];
+        free(expanded.v);
+    }
+    lsh_arith(text, cache, &value);
+    *outlen = snprintf(number, sizeof(number), "%lld", value);
+    return lsh_arena_strndup(number, *outlen);
+}
+
+//add the value of a substitution or variable to the word, unless it was quoted it is split into words on whitespace.
+void lsh_field_splice(struct lsh_field *f, struct lsh_argv *argv, const char *s, size_t n, int quoted){
+    size_t run;
+
+    while(n > 0){
+        run = quoted ? n : strcspn(s, LSH_IFS);
+        if(run > n){
+            run = n;
+        }
+        if(run > 0){
+            lsh_field_append(f, s, run, quoted);
+            s += run;
+            n -= run;
+        }
+        else{
+            if(f->have){
+                lsh_field_end(f, argv);
+            }
+            s++;
+            n--;
+        }
+    }
+}
+
+//if p is "$name", "${name}", "$1", "$?" or another special one, return where the reference ends and which name it is.
+const char *lsh_var_ref(const char *p, const char **name, size_t *n){
+    const char *end;
+
+    if(p[1] == '{' && (end = strchr(p + 2, '}')) != NULL){
+        *name = p + 2;
+        *n = end - p - 2;
+        return end + 1;
+    }
+    if(strchr("?$#@*!0123456789", p[1]) != NULL && p[1] != '\0'){
+        *name = p + 1;
+        *n = 1;
+        return p + 2;
+    }
+    for(end = p + 1; lsh_is_name(p + 1, end - p); end++){
+    }
+    if(end == p + 1){
+        return NULL;        //a lone '$' is just a dollar sign
+    }
+    *name = p + 1;
+    *n = end - p - 1;
+    return end;
+}
+
+/*
+function: lsh_expand_word
+expand one token into zero or more words appended to argv. with split set to 0 the token always gives exactly one word
+and is not globbed, that's what here-strings want.
+*/
+void lsh_expand_word(const char *p, struct lsh_argv *argv, int split){
+    struct lsh_field field = {{NULL, 0, 0}, {NULL, 0, 0}, 0, 0};
+    int dquote = 0;
+    const char *end, *name;
+    char *out;
+    size_t n, i;
+
+    //the common "$(cmd)" word on its own: split the captured output in place, the words point right into the arena.
+    if(split && p[0] == '$' && p[1] == '(' && p[2] != '(' && (end = lsh_match_paren(p + 2)) != NULL && end[1] == '\0'){
+        out = lsh_command_subst(p + 2, end - (p + 2), &n);
+        for(i = 0; i < n; i++){
+            if(strchr(LSH_IFS, out[i]) != NULL){
+                out[i] = '\0';
+            }
+        }
+        for(i = 0; i < n; i += strlen(out + i) + 1){
+            if(out[i] != '\0' && (!lsh_has_glob(out + i) || lsh_glob(out + i, argv) == 0)){
+                lsh_argv_push(argv, out + i);
+            }
+        }
+        return;
+    }
+
+    //"$@" gives each positional parameter as a word of its own, and no word at all if there are none.
+    //inside a longer word ("x$@y") the first one is glued to what comes before and the last to what comes after.
+    if(strcmp(p, "\"$@\"") == 0 || strcmp(p, "\"${@}\"") == 0){
+        for(i = 1; lsh_frame != NULL && (int)i <= lsh_frame->argc; i++){
+            lsh_argv_push(argv, lsh_frame->argv[i]);
+        }
+        return;
+    }
+
+    while(*p != '\0'){
+        if(*p == '\'' && !dquote && (end = strchr(p + 1, '\'')) != NULL){
+            lsh_field_append(&field, p + 1, end - p - 1, 1);
+            p = end + 1;
+        }
+        else if(*p == '"'){
+            dquote = !dquote;
+            field.have = 1;     //"" is an empty word, not no word
+            p++;
+        }
+        else if(*p == '\\' && p[1] != '\0'){
+            if(!dquote || strchr("$`\"\\\n", p[1]) != NULL){
+                lsh_field_append(&field, p + 1, 1, 1);
+            }
+            else{
+                lsh_field_append(&field, p, 2, 1);      //inside "..." a backslash only escapes a few characters
+            }
+            p += 2;
+        }
+        else if(*p == '$' && p[1] == '(' && p[2] == '(' && (end = lsh_match_paren(p + 2)) != NULL && end[-1] == ')'){
+            out = lsh_arith_subst(p + 3, end - 1 - (p + 3), &n);
+            lsh_field_splice(&field, argv, out, n, dquote || !split);
+            p = end + 1;
+        }
+        else if(*p == '$' && p[1] == '(' && (end = lsh_match_paren(p + 2)) != NULL){
+            out = lsh_command_subst(p + 2, end - (p + 2), &n);
+            lsh_field_splice(&field, argv, out, n, dquote || !split);
+            p = end + 1;
+        }
+        else if(*p == '$' && dquote && split && (end = lsh_var_ref(p, &name, &n)) != NULL && n == 1 && *name == '@'){
+            for(i = 1; lsh_frame != NULL && (int)i <= lsh_frame->argc; i++){
+                if(i > 1){
+                    lsh_field_end(&field, argv);
+                }
+                lsh_field_append(&field, lsh_frame->argv[i], strlen(lsh_frame->argv[i]), 1);
+            }
+            p = end;
+        }
+        else if(*p == '$' && (end = lsh_var_ref(p, &name, &n)) != NULL){
+            out = lsh_getvar(name, n);
+            if(out != NULL){
+                lsh_field_splice(&field, argv, out, strlen(out), dquote || !split);
+            }
+            p = end;
+        }
+        else{
+            lsh_field_append(&field, p, 1, dquote);
+            p++;
+        }
+    }
+
+    if(!split){
+        field.glob = 0;
+        lsh_field_end(&field, argv);
+    }
+    else if(field.have){
+        lsh_field_end(&field, argv);
+    }
+    free(field.text.data);
+    free(field.pattern.data);
+}
+
+//expand a whole argument list, the result is a NULL terminated array the caller has to free().
+char **lsh_expand(char **args){
+    struct lsh_argv argv = {NULL, 0, 0};
+    struct lsh_str word = {NULL, 0, 0};
+    struct lsh_brace *brace;
+    int i;
+
+    lsh_argv_push(&argv, NULL);     //make sure we return an array even if everything expands to nothing
+    argv.len = 0;
+    for(i = 0; args[i] != NULL; i++){
+        brace = lsh_brace_parse(args[i]);
+        if(brace == NULL){
+            lsh_expand_word(args[i], &argv, 1);
+            continue;
+        }
+        do{
+            word.len = 0;
+            lsh_brace_emit(brace, &word);
+            lsh_expand_word(word.data, &argv, 1);
+        }while(lsh_brace_next(brace));
+    }
+    free(word.data);
+    return argv.v;
+}
+
+/*
+here-documents (<<EOF ... EOF) and here-strings (<<<word) hand a block of inline text to a command as its stdin.
+
+other shells write the body into a temp file under /tmp and open it again, which costs a filesystem round trip.
+we never touch the filesystem: a body that fits into a pipe's buffer is written straight into a pipe (the write
+can't block because the kernel has room for all of it), anything bigger goes into a memfd, an anonymous file
+that only lives in memory and disappears with its last fd.
+*/
+int lsh_write_all(int fd, const char *buf, size_t len){
+    while(len > 0){
+        ssize_t n = write(fd, buf, len);
+        if(n < 0){
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int lsh_here_fd(const char *body, size_t len){
+    int fds[2], fd, cap;
+
+    if(pipe2(fds, O_CLOEXEC) == 0){
+        cap = fcntl(fds[1], F_GETPIPE_SZ);
+        if(cap >= 0 && len > (size_t)cap){
+            cap = fcntl(fds[1], F_SETPIPE_SZ, (int)len);     //try to grow it, this is capped by /proc/sys/fs/pipe-max-size
+        }
+        if(cap >= 0 && len <= (size_t)cap && lsh_write_all(fds[1], body, len) == 0){
+            close(fds[1]);      //the reader sees EOF once it drained the body
+            return fds[0];
+        }
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    fd = memfd_create("lsh-heredoc", MFD_CLOEXEC);
+    if(fd < 0 || lsh_write_all(fd, body, len) != 0 || lseek(fd, 0, SEEK_SET) != 0){
+        perror("lsh");
+        if(fd >= 0){
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+//read the lines of a here-document up to the delimiter line, "<<-" also strips the leading tabs of each line.
+char *lsh_read_heredoc(const char *delim, int strip_tabs, size_t *len){
+    char *body = NULL, *line = NULL, *text;
+    size_t cap = 0, bufsize = 0, n;
+    ssize_t nread;
+
+    *len = 0;
+    for(;;){
+        if(lsh_script == NULL && isatty(STDIN_FILENO)){
+            printf("> ");       //continuation prompt
+            fflush(stdout);
+        }
+        nread = getline(&line, &bufsize, lsh_script ? lsh_script : stdin);
+        if(nread == -1){
+            fprintf(stderr, "lsh: warning: here-document delimited by end-of-file (wanted `%s')\n", delim);
+            break;
+        }
+        text = line;
+        if(strip_tabs){
+            while(*text == '\t'){
+                text++;
+            }
+        }
+        n = strlen(text);
+        if(n > 0 && text[n - 1] == '\n'){
+            text[--n] = '\0';      //compare the delimiter without the newline, then put it back
+            if(strcmp(text, delim) == 0){
+                break;
+            }
+            text[n++] = '\n';
+        }
+        else if(strcmp(text, delim) == 0){
+            break;
+        }
+        if(*len + n + 1 > cap){
+            cap = (*len + n + 1) * 2;
+            body = realloc(body, cap);
+            if(!body){
+                fprintf(stderr,"lsh: allocation error\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        memcpy(body + *len, text, n);
+        *len += n;
+    }
+    free(line);
+    return body;
+}
+
+//strip the quotes of a here-document delimiter like 'EOF', "EOF" or \EOF in place. *quoted says if it had any.
+char *lsh_unquote_delim(char *delim, int *quoted){
+    char *p, *q;
+
+    *quoted = 0;
+    for(p = q = delim; *p != '\0'; p++){
+        if(*p == '\'' || *p == '"' || *p == '\\'){
+            *quoted = 1;
+        }
+        else{
+            *q++ = *p;
+        }
+    }
+    *q = '\0';
+    return delim;
+}
+
+/*
+the bodies of here-documents follow the line that has the "<<" in it, so they are read as soon as that line has been
+split, before anything runs: a here-document inside a loop is read once and fed to every round.
+the delimiter token is replaced by the body, so from here on the word after "<<" is the text itself. its $name, $(...)
+and $((...)) are expanded every time the command runs (see lsh_expand_heredoc()), unless the delimiter was quoted:
+then the body's backslashes and dollars are escaped here, and the expansion gives the text back as it was.
+*/
+void lsh_read_heredocs(char **tokens){
+    struct lsh_str text = {NULL, 0, 0};
+    char *body;
+    size_t len, k;
+    int i, quoted;
+
+    for(i = 0; tokens[i] != NULL && tokens[i + 1] != NULL; i++){
+        if(lsh_is_token(tokens[i], "<<") || lsh_is_token(tokens[i], "<<-")){
+            body = lsh_read_heredoc(lsh_unquote_delim(tokens[i + 1], &quoted), tokens[i][2] == '-', &len);
+            text.len = 0;
+            for(k = 0; k < len; k++){
+                if(quoted && (body[k] == '\\' || body[k] == '$')){
+                    lsh_str_append(&text, "\\", 1);
+                }
+                lsh_str_append(&text, body + k, 1);
+            }
+            tokens[++i] = lsh_arena_strndup(text.data ? text.data : "", text.len);
+            free(body);
+        }
+    }
+    free(text.data);
+}
+
+/*
+function: lsh_expand_heredoc
+the body of a here-document as the command gets it. it is expanded like a word in double quotes but never split, and
+quotes are just characters in it. a backslash only escapes $, ` and itself, and joins a line with the next one.
+*/
+void lsh_expand_heredoc(const char *p, struct lsh_str *out){
+    const char *end, *name;
+    char *value;
+    size_t n;
+
+    while(*p != '\0'){
+        if(*p == '\\' && p[1] != '\0' && strchr("$`\\\n", p[1]) != NULL){
+            lsh_str_append(out, p + 1, p[1] != '\n');
+            p += 2;
+        }
+        else if(*p == '$' && p[1] == '(' && p[2] == '(' && (end = lsh_match_paren(p + 2)) != NULL && end[-1] == ')'){
+            value = lsh_arith_subst(p + 3, end - 1 - (p + 3), &n);
+            lsh_str_append(out, value, n);
+            p = end + 1;
+        }
+        else if(*p == '$' && p[1] == '(' && (end = lsh_match_paren(p + 2)) != NULL){
+            value = lsh_command_subst(p + 2, end - (p + 2), &n);
+            lsh_str_append(out, value, n);
+            p = end + 1;
+        }
+        else if(*p == '$' && (end = lsh_var_ref(p, &name, &n)) != NULL){
+            value = lsh_getvar(name, n);
+            if(value != NULL){
+                lsh_str_append(out, value, strlen(value));
+            }
+            p = end;
+        }
+        else{
+            lsh_str_append(out, p, 1);
+            p++;
+        }
+    }
+}
+
+/*
+function: lsh_redirect
+take the here-document and here-string operators and their words out of args, the other words are added to words.
+it returns the fd that should become the command's stdin, -1 if there is no redirection and -2 on error.
+*/
+int lsh_redirect(char **args, struct lsh_argv *words){
+    int in_fd = -1, i;
+    struct lsh_argv expanded = {NULL, 0, 0};
+    struct lsh_str text = {NULL, 0, 0};
+    char *body;
+    size_t len;
+
+    lsh_argv_push(words, NULL);     //make sure the array exists even if no word is left
+    words->len = 0;
+    for(i = 0; args[i] != NULL; i++){
+        if(!lsh_is_operator(args[i]) || strncmp(args[i], "<<", 2) != 0 || args[i + 1] == NULL){
+            lsh_argv_push(words, args[i]);        //not a redirection, keep it
+            continue;
+        }
+
+        if(in_fd >= 0){
+            close(in_fd);       //like any redirection, the last one wins
+        }
+        if(lsh_is_token(args[i], "<<<")){
+            lsh_expand_word(args[i + 1], &expanded, 0);
+            len = strlen(expanded.v[0]);
+            body = lsh_arena_alloc(len + 1);        //a here-string is the word plus a newline
+            memcpy(body, expanded.v[0], len);
+            body[len] = '\n';
+            expanded.len = 0;
+            in_fd = lsh_here_fd(body, len + 1);
+        }
+        else{
+            text.len = 0;
+            lsh_expand_heredoc(args[i + 1], &text);
+            in_fd = lsh_here_fd(text.data ? text.data : "", text.len);
+        }
+        i++;
+        if(in_fd < 0){
+            free(expanded.v);
+            free(text.data);
+            return -2;
+        }
+    }
+    free(expanded.v);
+    free(text.data);
+    return in_fd;
+}
+
+//this function will either launch a builtin, or a process.
+int lsh_execute(char** args){
+    struct lsh_argv words = {NULL, 0, 0}, assigns = {NULL, 0, 0}, value = {NULL, 0, 0};
+    int i, n, status, in_fd, saved_in = -1, direct = lsh_exec_direct;
+    char **argv, **cmd_assigns, *eq, *env;
+    struct lsh_func *func;
+
+    lsh_exec_direct = 0;        //a $(...) in the words or the body of a function still has to fork
+    in_fd = lsh_redirect(args, &words);
+    if(in_fd == -2){
+        free(words.v);
+        lsh_last_status = 1;
+        return 1;
+    }
+
+    //NAME=value words in front of the command set shell variables, or only the command's environment if there is one
+    for(n = 0; words.v[n] != NULL && lsh_is_assignment(words.v[n]); n++){
+    }
+    lsh_expand_alias(&words, n);
+    argv = lsh_expand(words.v + n);
+    for(i = 0; i < n; i++){
+        eq = strchr(words.v[i], '=');
+        value.len = 0;
+        lsh_expand_word(eq + 1, &value, 0);
+        if(argv[0] == NULL){
+            lsh_setvar(lsh_arena_strndup(words.v[i], eq - words.v[i]), value.v[0], 0);
+        }
+        else{
+            env = lsh_arena_alloc(eq + 1 - words.v[i] + strlen(value.v[0]) + 1);
+            memcpy(env, words.v[i], eq + 1 - words.v[i]);
+            strcpy(env + (eq + 1 - words.v[i]), value.v[0]);
+            lsh_argv_push(&assigns, env);
+        }
+    }
+    free(value.v);
+    free(words.v);
+
+    if(argv[0] == NULL){
+        // an empty command was entered
+        if(in_fd >= 0){
+            close(in_fd);
+        }
+        free(argv);
+        free(assigns.v);
+        lsh_last_status = 0;
+        return 1;
+    }
+
+    if(in_fd >= 0){
+        //the builtin or the child sees the body on fd 0, the shell's own stdin is parked and put back afterwards.
+        saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+        dup2(in_fd, STDIN_FILENO);
+        close(in_fd);
+    }
+
+    status = -1;
+    if((func = lsh_findfunc(argv[0])) != NULL){     //functions come first, they can even replace a builtin
+        status = lsh_call_function(func, argv);
+    }
+    for(i = 0; status == -1 && i < lsh_num_builtis(); i++){
+        if(strcmp(argv[0], builtin_str[i]) == 0){ //to check if the command equals each builtin
+            lsh_rc_builtin(argv[0]);
+            lsh_prev_status = lsh_last_status;
+            lsh_last_status = 0;        //a builtin only sets it when something goes wrong
+            cmd_assigns = lsh_cmd_assigns;
+            lsh_cmd_assigns = assigns.v;
+            status = (*builtin_func[i])(argv);   //if so, run it
+            lsh_cmd_assigns = cmd_assigns;
+            break;
+        }
+    }
+    if(status == -1){
+        lsh_exec_direct = direct;
+        status = lsh_launch(argv, assigns.v);    //if doesn't match a builtin, it calls lsh_launch() to launch the process.
+    }
+
+    if(saved_in >= 0){
+        dup2(saved_in, STDIN_FILENO);
+        close(saved_in);
+    }
+    free(argv);
+    free(assigns.v);
+    return status;
+
+}
+
+/*
+a "for" loop: every word in its list is expanded (and, if it has braces, generated one word at a time), then the
+variable is set to each resulting word in turn and the body runs. each round hands its arena memory back.
+*/
+int lsh_exec_node(struct lsh_node *node);
+
+int lsh_exec_for(struct lsh_node *node){
+    struct lsh_argv items = {NULL, 0, 0};
+    struct lsh_str word = {NULL, 0, 0};
+    struct lsh_arena_pos word_pos, round_pos;
+    struct lsh_brace *brace;
+    int i, k, status = 1;
+
+    lsh_last_status = 0;
+    for(i = 0; status && !lsh_returning && !lsh_interrupted && node->words[i] != NULL; i++){
+        brace = lsh_brace_parse(node->words[i]);
+        do{
+            word.len = 0;
+            lsh_str_append(&word, node->words[i], brace ? 0 : strlen(node->words[i]));
+            if(brace != NULL){
+                lsh_brace_emit(brace, &word);
+            }
+            word_pos = lsh_arena_mark();
+            items.len = 0;
+            lsh_expand_word(word.data, &items, 1);
+            round_pos = lsh_arena_mark();
+            for(k = 0; status && !lsh_returning && !lsh_interrupted && k < items.len; k++){
+                lsh_setvar(node->name, items.v[k], 0);
+                status = lsh_exec_node(node->right);
+                lsh_arena_release(round_pos);
+            }
+            lsh_arena_release(word_pos);
+        }while(status && !lsh_returning && !lsh_interrupted && brace != NULL && lsh_brace_next(brace));
+    }
+    free(items.v);
+    free(word.data);
+    return status;
+}
+
+/*
+a pipeline "a | b | c", or anything run with "&", is a job. every stage is forked into the job's process group with
+its stdin and stdout connected to its neighbours by pipes. a stage that is a simple command execs right in the child,
+anything else (a builtin, a loop, a function) runs in the child through lsh_exec_node() and exits with its status.
+*/
+/*
+a builtin in a pipeline. other shells fork a subshell for it, but the builtins that only print something (help, history,
+set and trap without arguments, alias without definitions) don't change anything in the shell, so a thread of the
+shell writes what they print into the pipe. "history | grep make" forks for grep only. what they print comes from the
+shell's state, which the shell goes on to change (the prompt adds to the history, "unalias" frees an alias) while the
+thread may still be writing, so they run right away on the shell's thread into a buffer and the thread writes only
+that. cat and tee read the pipe from the stage before and only touch their fds, they run on the thread.
+the thread blocks SIGPIPE: when the reader is gone the write fails with EPIPE, it doesn't kill the shell.
+a builtin that changes the shell (cd, set -o, ...), a function or an alias still runs in a forked child, where its
+changes are lost like in a subshell.
+*/
+struct lsh_stage{
+    struct lsh_stage *next;
+    pthread_t thread;
+    int (*func)(char**);        //cat or tee, NULL when the builtin ran already and its output is in text
+    char **argv;        //malloc()ed, the thread may outlive the command line and its arena
+    char *text;     //what the builtin printed, malloc()ed by open_memstream()
+    size_t len;
+    int fd;     //the pipe to the next stage, -1 for the last stage, which prints to stdout
+    int in;     //the pipe from the stage before for cat and tee, -1 for the others
+    int done;       //an eventfd the last stage signals when the shell waits for builtins only, or -1
+    int last;       //joined for its status, the others clean up after themselves
+    int status;
+};
+
+void lsh_free_stage(struct lsh_stage *st){
+    int i;
+
+    for(i = 0; st->argv[i] != NULL; i++){
+        free(st->argv[i]);
+    }
+    free(st->argv);
+    free(st->text);
+    free(st);
+}
+
+void *lsh_stage_thread(void *arg){
+    struct lsh_stage *st = arg;
+    sigset_t pipe_mask;
+
+    sigemptyset(&pipe_mask);
+    sigaddset(&pipe_mask, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_mask, NULL);
+    lsh_in = st->in;
+    if(st->func == NULL){
+        if(lsh_write_all(st->fd >= 0 ? st->fd : STDOUT_FILENO, st->text, st->len) < 0 && errno != EPIPE){
+            perror("lsh");
+        }
+        if(st->fd >= 0){
+            close(st->fd);
+        }
+    }
+    else if((lsh_out = st->fd >= 0 ? fdopen(st->fd, "w") : stdout) == NULL){
+        close(st->fd);
+        st->status = 1;
+    }
+    else{
+        (*st->func)(st->argv);
+        st->status = lsh_last_status;
+        if(lsh_out != stdout){
+            fclose(lsh_out);        //the reader sees the end of its input
+        }
+        else{
+            fflush(stdout);
+        }
+    }
+    if(st->in >= 0){
+        close(st->in);      //the writer gets EPIPE if this stage stopped early
+    }
+    if(st->done >= 0){
+        eventfd_write(st->done, 1);
+    }
+    if(!st->last){
+        lsh_free_stage(st);
+    }
+    return NULL;
+}
+
+//the stage as a builtin to run on a thread, NULL if it has to be forked. in is the pipe from the stage before, or -1.
+struct lsh_stage *lsh_stage_builtin(struct lsh_node *stage, int in, int fd){
+    struct lsh_stage *st;
+    char **words, **argv;
+    int i, n, status, copy = 0;
+
+    if(stage->type != LSH_NODE_CMD){
+        return NULL;
+    }
+    words = stage->words;
+    for(i = 0; words[i] != NULL; i++){
+        if(lsh_is_operator(words[i]) || strstr(words[i], "$(") != NULL || strchr(words[i], '`') != NULL){
+            return NULL;        //a here-document, or a command substitution that would run before the pipeline
+        }
+    }
+    if(lsh_findfunc(words[0]) != NULL || lsh_findalias(words[0]) != NULL){
+        return NULL;
+    }
+    for(i = 0; i < lsh_num_builtis(); i++){
+        if(strcmp(words[0], builtin_str[i]) == 0){
+            break;
+        }
+    }
+    if(!(strcmp(words[0], "help") == 0 || strcmp(words[0], "history") == 0
+         || ((strcmp(words[0], "set") == 0 || strcmp(words[0], "trap") == 0) && words[1] == NULL)
+         || strcmp(words[0], "alias") == 0 || (copy = strcmp(words[0], "cat") == 0 || strcmp(words[0], "tee") == 0))){
+        return NULL;
+    }
+    for(n = 1; strcmp(words[0], "alias") == 0 && words[n] != NULL; n++){
+        if(strchr(words[n], '=') != NULL){
+            return NULL;
+        }
+    }
+
+    argv = lsh_expand(words);
+    if(copy && (lsh_copy_options(argv) || (in < 0 && lsh_copy_stdin(argv)))){
+        free(argv);     //an option only the program has, or the first stage would read the shell's stdin
+        return NULL;
+    }
+    for(n = 0; argv[n] != NULL; n++){
+    }
+    st = calloc(1, sizeof(*st));
+    if(!st || !(st->argv = malloc((n + 1) * sizeof(char*)))){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    for(n = 0; argv[n] != NULL; n++){
+        st->argv[n] = lsh_strdup(argv[n]);
+    }
+    st->argv[n] = NULL;
+    free(argv);
+    st->func = builtin_func[i];
+    st->fd = fd;
+    st->in = copy ? in : -1;
+    st->done = -1;
+    st->last = fd < 0;
+    if(!copy){
+        status = lsh_last_status;
+        lsh_out = open_memstream(&st->text, &st->len);
+        if(lsh_out == NULL){
+            fprintf(stderr,"lsh: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        lsh_last_status = 0;
+        (*st->func)(st->argv);
+        fclose(lsh_out);
+        lsh_out = NULL;
+        st->status = lsh_last_status;
+        st->func = NULL;
+        lsh_last_status = status;
+    }
+    return st;
+}
+
+/*
+a pipeline of builtins only, "cat big | tee copy": there is no child to get the Ctrl-C, the shell does. so it waits for
+the last stage and the signalfd at once, and on a signal tells the threads to stop.
+*/
+void lsh_wait_stages(struct lsh_stage *last){
+    struct pollfd fds[2] = {{lsh_sigfd, POLLIN, 0}, {last->done, POLLIN, 0}};
+
+    while(poll(fds, 2, -1) >= 0 || errno == EINTR){
+        if(fds[1].revents & POLLIN){
+            break;
+        }
+        if(fds[0].revents & POLLIN){
+            atomic_store(&lsh_stage_cancel, 1);     //the signal itself is handled after the command, as usual
+            fds[0].fd = -1;
+        }
+    }
+}
+
+/*
+"set -o maxjobs=N": a script can start a job for every file with "&", and the shell only starts the next one when fewer
+than N background jobs are running. while it waits it polls a pidfd of every running child together with the signalfd,
+so the jobs that finish are reaped as they go and Ctrl-C still gets through. it returns -1 when Ctrl-C said not to
+start the job at all.
+*/
+int lsh_running_jobs(void){
+    struct lsh_job *job;
+    int n = 0;
+
+    for(job = lsh_jobs; job != NULL; job = job->next){
+        n += job->background && lsh_job_state(job) == LSH_PROC_RUNNING;
+    }
+    return n;
+}
+
+int lsh_throttle_jobs(void){
+    struct pollfd *fds = NULL;
+    struct lsh_job *job;
+    int n, i;
+
+    while(lsh_max_jobs > 0 && !lsh_interrupted && lsh_running_jobs() >= lsh_max_jobs){
+        n = 1;
+        for(job = lsh_jobs; job != NULL; job = job->next){
+            n += job->npids;
+        }
+        fds = realloc(fds, n * sizeof(*fds));
+        if(!fds){
+            fprintf(stderr,"lsh: allocation error\n");
+            exit(EXIT_FAILURE);
+        }
+        fds[0].fd = lsh_sigfd;
+        fds[0].events = POLLIN;
+        n = 1;
+        for(job = lsh_jobs; job != NULL; job = job->next){
+            for(i = 0; job->background && i < job->npids; i++){
+                if(job->states[i] == LSH_PROC_RUNNING && (fds[n].fd = syscall(SYS_pidfd_open, job->pids[i], 0)) >= 0){
+                    fds[n++].events = POLLIN;       //readable once the child has exited
+                }
+            }
+        }
+        //a child that stops tells no pidfd, we look again after a while. without pidfds (before Linux 5.3) sooner
+        if(poll(fds, n, n > 1 ? 1000 : 10) > 0 && (fds[0].revents & POLLIN)){
+            lsh_handle_signals();
+        }
+        for(i = 1; i < n; i++){
+            close(fds[i].fd);
+        }
+        lsh_reap_jobs();
+    }
+    free(fds);
+    return lsh_interrupted ? -1 : 0;
+}
+
+int lsh_exec_job(struct lsh_node *node, int background){
+    struct lsh_node **stages = NULL, *n;
+    struct lsh_str text = {NULL, 0, 0};
+    struct lsh_job *job;
+    struct lsh_stage *threads = NULL, *st, *last = NULL, *next;
+    struct lsh_placement place;
+    int nstages = 0, i, fds[2], in_fd = -1, interactive = lsh_job_control;
+    pthread_t thread;
+    pid_t pid;
+
+    lsh_rc_impure();
+    if(background && lsh_throttle_jobs() < 0){
+        lsh_last_status = 128 + SIGINT;
+        return 1;
+    }
+    for(n = node; n->type == LSH_NODE_PIPE; n = n->left){      //"a | b | c" is PIPE(PIPE(a, b), c)
+        nstages++;
+    }
+    nstages++;
+    stages = malloc(nstages * sizeof(*stages));
+    if(!stages){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    i = nstages;
+    for(n = node; n->type == LSH_NODE_PIPE; n = n->left){
+        stages[--i] = n->right;
+    }
+    stages[0] = n;
+
+    lsh_node_text(node, &text);
+    job = lsh_new_job(text.data ? text.data : "", background);
+    free(text.data);
+    if(background){
+        lsh_spread_job(&place);
+    }
+    else{
+        place.has_cpus = 0;
+        place.node = -1;
+    }
+
+    fflush(stdout);
+    for(i = 0; i < nstages; i++){
+        fds[0] = fds[1] = -1;
+        if(i + 1 < nstages && pipe2(fds, O_CLOEXEC) < 0){
+            perror("lsh");
+            break;
+        }
+        if((st = lsh_stage_builtin(stages[i], in_fd, fds[1])) != NULL){        //started once all the children are forked
+            st->next = threads;
+            threads = st;
+            if(in_fd >= 0 && st->in < 0){
+                close(in_fd);       //it reads nothing, the stage before gets EPIPE like with any such program
+            }
+            in_fd = fds[0];
+            continue;
+        }
+        pid = fork();
+        if(pid == 0){
+            for(st = threads; st != NULL; st = st->next){
+                if(st->fd >= 0){
+                    close(st->fd);      //the write end belongs to the thread, its reader must see EOF when it is done
+                }
+                if(st->in >= 0){
+                    close(st->in);
+                }
+            }
+            lsh_child_setup(job->npids ? job->pgid : 0, !background);
+            lsh_cgroup_enter(job, 0);
+            lsh_place(&place);
+            if(in_fd >= 0){
+                dup2(in_fd, STDIN_FILENO);
+            }
+            else if(background && !interactive && (in_fd = open("/dev/null", O_RDONLY)) >= 0){
+                dup2(in_fd, STDIN_FILENO);      //without job control a background job must not eat the script's input
+            }
+            if(fds[1] >= 0){
+                dup2(fds[1], STDOUT_FILENO);
+            }
+            lsh_exec_direct = stages[i]->type == LSH_NODE_CMD;
+            lsh_exec_node(stages[i]->type == LSH_NODE_SUBSHELL ? stages[i]->left : stages[i]);     //a child is a subshell already
+            lsh_run_exit_trap();        //its own, lsh_child_setup() dropped the shell's
+            fflush(stdout);     //not NULL: flushing the script we read from would move its offset, which the shell shares
+            _exit(lsh_last_status);
+        }
+        if(pid < 0){
+            perror("lsh");
+            if(fds[0] >= 0){
+                close(fds[0]);
+                close(fds[1]);
+            }
+            break;
+        }
+        if(lsh_job_control){
+            setpgid(pid, job->npids ? job->pgid : pid);
+        }
+        lsh_job_add_pid(job, pid);
+        if(in_fd >= 0){
+            close(in_fd);
+        }
+        if(fds[1] >= 0){
+            close(fds[1]);
+        }
+        in_fd = fds[0];
+    }
+    if(in_fd >= 0){
+        close(in_fd);
+    }
+    free(stages);
+
+    atomic_store(&lsh_stage_cancel, 0);
+    for(st = threads; st != NULL; st = next){
+        next = st->next;
+        if(st->last && !background){
+            last = st;
+        }
+        st->last = st == last;
+        if(st == last && job->npids == 0){
+            last->done = eventfd(0, EFD_CLOEXEC);
+        }
+        if(pthread_create(&thread, NULL, lsh_stage_thread, st) != 0){
+            lsh_stage_thread(st);       //no thread, then it runs right here
+            thread = pthread_self();
+        }
+        else if(st != last){
+            pthread_detach(thread);     //it may be gone already, st with it
+        }
+        if(st == last){
+            last->thread = thread;
+        }
+    }
+
+    if(job->npids == 0 && threads != NULL){
+        lsh_free_job(job);      //nothing but builtins
+    }
+    else if(job->npids == 0){
+        lsh_free_job(job);
+        lsh_last_status = 1;
+    }
+    else if(background){
+        lsh_last_bg_pid = job->pids[job->npids - 1];
+        if(lsh_job_control){
+            fprintf(stderr, "[%d] %d\n", job->id, (int)lsh_last_bg_pid);
+        }
+        lsh_last_status = 0;
+    }
+    else{
+        lsh_foreground_job(job, 0);
+    }
+    if(last != NULL){
+        if(last->done >= 0){
+            lsh_wait_stages(last);
+        }
+        if(!pthread_equal(last->thread, pthread_self())){
+            pthread_join(last->thread, NULL);
+        }
+        if(last->done >= 0){
+            close(last->done);
+        }
+        lsh_last_status = last->status;
+        lsh_free_stage(last);
+    }
+    return 1;
+}
+
+/*
+a subshell, "( list )". whatever the list changes (variables, the working directory, options) must not be seen
+afterwards, and an "exit" in it only ends the subshell. other shells fork for that. we only fork when we must: the
+working directory is kept as an fd and gone back to with fchdir(), the variables the list changes are saved in a
+layer (see lsh_layer_save()) and put back, the options are copied. the programs the list runs can't change our state,
+they are started as usual. what we can't undo this way are functions, aliases and traps being defined, and jobs being
+started or handled, so a list that may do that (we look into the aliases and functions it calls) runs in a fork.
+*/
+char *lsh_subshell_forks[] = {
+    "alias",
+    "unalias",
+    "trap",
+    "jobs",
+    "fg",
+    "bg",
+    "cgroup",
+    "ulimit"
+};
+
+int lsh_needs_fork(struct lsh_node *node, int depth);
+
+int lsh_command_needs_fork(char **words, int depth){
+    struct lsh_alias *alias;
+    struct lsh_func *func;
+    size_t i;
+
+    for(; *words != NULL && lsh_is_assignment(*words); words++){
+    }
+    if(*words == NULL){
+        return 0;
+    }
+    if(depth > LSH_SUBSHELL_SCAN_DEPTH || strpbrk(*words, "$`\\'\"<") != NULL){
+        return 1;       //we can't tell what it is going to run
+    }
+    if((alias = lsh_findalias(*words)) != NULL){
+        return lsh_command_needs_fork(alias->words, depth + 1);
+    }
+    if((func = lsh_findfunc(*words)) != NULL){
+        return lsh_needs_fork(func->body, depth + 1);
+    }
+    for(i = 0; i < sizeof(lsh_subshell_forks) / sizeof(char*); i++){
+        if(strcmp(*words, lsh_subshell_forks[i]) == 0){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int lsh_needs_fork(struct lsh_node *node, int depth){
+    if(node == NULL){
+        return 0;
+    }
+    switch(node->type){
+    case LSH_NODE_BG:
+    case LSH_NODE_FUNC:
+        return 1;
+    case LSH_NODE_CMD:
+        return lsh_command_needs_fork(node->words, depth);
+    }
+    return lsh_needs_fork(node->left, depth) || lsh_needs_fork(node->right, depth);
+}
+
+int lsh_exec_subshell(struct lsh_node *node){
+    struct lsh_layer layer;
+    int *options, cwd, i, returning = lsh_returning;
+
+    if(lsh_needs_fork(node->left, 0) || (cwd = open(".", O_PATH | O_CLOEXEC)) < 0){
+        return lsh_exec_job(node, 0);
+    }
+    options = malloc(lsh_num_options() * sizeof(int));
+    if(!options){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    for(i = 0; i < lsh_num_options(); i++){
+        options[i] = *option_val[i];
+    }
+    layer.prev = lsh_layer;
+    layer.saved = NULL;
+    lsh_layer = &layer;
+
+    lsh_exec_node(node->left);      //an "exit" only leaves the subshell
+
+    lsh_layer = NULL;       //putting the values back is no change the outer layer has to save
+    lsh_restore_locals(layer.saved);
+    lsh_layer = layer.prev;
+    for(i = 0; i < lsh_num_options(); i++){
+        *option_val[i] = options[i];
+    }
+    free(options);
+    if(fchdir(cwd) != 0){
+        perror("lsh");
+    }
+    close(cwd);
+    lsh_returning = returning;      //and so does a "return"
+    return 1;
+}
+
+//run a parsed command line, like lsh_execute() it returns 0 when the shell should exit.
+int lsh_exec_node(struct lsh_node *node){
+    int status;
+
+    if(node == NULL){
+        return 1;
+    }
+    switch(node->type){
+    case LSH_NODE_CMD:
+        status = lsh_execute(node->words);
+        lsh_after_command();
+        return status;
+    case LSH_NODE_PIPE:
+        status = lsh_exec_job(node, 0);
+        lsh_after_command();
+        return status;
+    case LSH_NODE_BG:
+        return lsh_exec_job(node->left, 1);
+    case LSH_NODE_SEQ:
+        if(!lsh_exec_node(node->left)){
+            return 0;
+        }
+        return lsh_returning || lsh_interrupted ? 1 : lsh_exec_node(node->right);
+    case LSH_NODE_AND:
+    case LSH_NODE_OR:
+        lsh_in_condition++;
+        status = lsh_exec_node(node->left);
+        lsh_in_condition--;
+        if(!status){
+            return 0;
+        }
+        if(!lsh_returning && !lsh_interrupted && (lsh_last_status == 0) == (node->type == LSH_NODE_AND)){
+            return lsh_exec_node(node->right);
+        }
+        return 1;
+    case LSH_NODE_FOR:
+        return lsh_exec_for(node);
+    case LSH_NODE_FUNC:
+        lsh_define_function(node->name, node->right);
+        lsh_last_status = 0;
+        return 1;
+    case LSH_NODE_SUBSHELL:
+        status = lsh_exec_subshell(node);
+        lsh_after_command();
+        return status;
+    case LSH_NODE_GROUP:
+        return lsh_exec_node(node->left);
+    }
+    return 1;
+}
+
+//split, parse and run a piece of text that is a complete command line, in a subshell if asked to.
+int lsh_run_text(char *text, int subshell){
+    char **tokens = lsh_split_line(text);
+    struct lsh_node *node;
+    int incomplete, status = 1;
+
+    lsh_read_heredocs(tokens);
+    node = lsh_parse(tokens, &incomplete);
+    if(incomplete){
+        fprintf(stderr, "lsh: syntax error: unexpected end of file\n");
+        lsh_last_status = 2;
+    }
+    else if(subshell){
+        lsh_exec_subshell(lsh_new_node(LSH_NODE_SUBSHELL, node, NULL));
+    }
+    else{
+        status = lsh_exec_node(node);
+    }
+    free(tokens);
+    return status;
+}
+
+int lsh_run(char *text){
+    return lsh_run_text(text, 0);
+}
+
+/*
+the startup file. an interactive shell runs ~/.lshrc before its first prompt. what such a file leaves behind is
+almost always the same few variables, functions, aliases, options and traps, so once it has run we write that state to
+~/.lshrc.snap together with a hash of the file. the next shell that finds the hash still matching maps the snapshot
+and sets the state from it, without lexing, parsing or running anything. the snapshot is a header and then a list of
+'\0'-terminated strings, like the history file.
+
+that is only right if running the file again would end in the same state, so while it runs we watch it:
+every variable it reads before setting it is written down with the value it had, and the snapshot is only used if
+they all still have those values (another $PATH in the environment means running the file again). running a
+program, a pipeline or a background job, a glob, $$ or $!, and the builtins other than set, let, local, return,
+trap, alias and unalias have effects a snapshot can't repeat. a file that does any of that is run at every startup, as usual.
+*/
+struct lsh_rc_header{
+    char magic[8];
+    uint64_t hash;      //of the startup file
+    uint64_t size;      //of the whole snapshot, one that got cut short is not used
+};
+
+struct lsh_rc_trace{
+    int on;
+    int pure;
+    struct lsh_argv seen;       //the variables it read or set so far
+    struct lsh_argv set;        //the ones it set
+    struct lsh_str reads;       //an "R" record for each variable it read before setting it
+};
+
+struct lsh_rc_trace lsh_rc = {0, 0, {NULL, 0, 0}, {NULL, 0, 0}, {NULL, 0, 0}};
+
+char *lsh_rc_pure_builtins[] = {
+    "set",
+    "let",
+    "local",
+    "return",
+    "trap",
+    "alias",
+    "unalias"
+};
+
+uint64_t lsh_rc_hash(const char *s, size_t n){
+    uint64_t h = 14695981039346656037ULL;     //FNV-1a, 64 bits
+    size_t i;
+
+    for(i = 0; i < n; i++){
+        h = (h ^ (unsigned char)s[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+void lsh_rc_impure(void){
+    lsh_rc.pure = 0;
+}
+
+void lsh_rc_builtin(const char *name){
+    size_t i;
+
+    for(i = 0; i < sizeof(lsh_rc_pure_builtins) / sizeof(char*); i++){
+        if(strcmp(name, lsh_rc_pure_builtins[i]) == 0){
+            return;
+        }
+    }
+    lsh_rc_impure();
+}
+
+int lsh_rc_find(struct lsh_argv *names, const char *name, size_t n){
+    int i;
+
+    for(i = 0; i < names->len; i++){
+        if(strncmp(names->v[i], name, n) == 0 && names->v[i][n] == '\0'){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void lsh_snap_put(struct lsh_str *snap, const char *s){
+    lsh_str_append(snap, s, strlen(s) + 1);
+}
+
+//a string that may be NULL: "" for NULL, '=' in front of it otherwise.
+void lsh_snap_put_opt(struct lsh_str *snap, const char *s){
+    if(s == NULL){
+        lsh_snap_put(snap, "");
+        return;
+    }
+    lsh_str_append(snap, "=", 1);
+    lsh_snap_put(snap, s);
+}
+
+void lsh_rc_read(const char *name, size_t n, const char *value){
+    char *copy;
+
+    if(!lsh_rc.on || lsh_rc_find(&lsh_rc.seen, name, n)){
+        return;     //not running the file, or the value came from the file itself
+    }
+    copy = strndup(name, n);
+    if(!copy){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    lsh_argv_push(&lsh_rc.seen, copy);
+    lsh_snap_put(&lsh_rc.reads, "R");
+    lsh_snap_put(&lsh_rc.reads, copy);
+    lsh_snap_put_opt(&lsh_rc.reads, value);
+}
+
+void lsh_rc_wrote(const char *name){
+    if(!lsh_rc.on || lsh_rc_find(&lsh_rc.set, name, strlen(name))){
+        return;
+    }
+    if(!lsh_rc_find(&lsh_rc.seen, name, strlen(name))){
+        lsh_argv_push(&lsh_rc.seen, lsh_strdup(name));
+    }
+    lsh_argv_push(&lsh_rc.set, lsh_strdup(name));
+}
+
+struct lsh_snap_reader{
+    char *p, *end;
+    int bad;        //the snapshot ended in the middle of something
+};
+
+//the next string of the snapshot. "" once it is used up, and then bad is set.
+char *lsh_snap_get(struct lsh_snap_reader *r){
+    char *s = r->p, *nul;
+
+    if(r->bad || s >= r->end || (nul = memchr(s, '\0', r->end - s)) == NULL){
+        r->bad = 1;
+        return "";
+    }
+    r->p = nul + 1;
+    return s;
+}
+
+char *lsh_snap_get_opt(struct lsh_snap_reader *r){
+    char *s = lsh_snap_get(r);
+
+    return s[0] == '=' ? s + 1 : NULL;
+}
+
+/*
+a function body is a tree of nodes. a node goes out as its type, its name, the number of its words (-1 if it has
+none) and the words, then its left and its right side the same way. "" stands for a missing node.
+*/
+void lsh_snap_put_node(struct lsh_str *snap, struct lsh_node *node){
+    char number[32];
+    int n;
+
+    if(node == NULL){
+        lsh_snap_put(snap, "");
+        return;
+    }
+    snprintf(number, sizeof(number), "%d", node->type);
+    lsh_snap_put(snap, number);
+    lsh_snap_put_opt(snap, node->name);
+    for(n = 0; node->words != NULL && node->words[n] != NULL; n++){
+    }
+    snprintf(number, sizeof(number), "%d", node->words ? n : -1);
+    lsh_snap_put(snap, number);
+    for(n = 0; node->words != NULL && node->words[n] != NULL; n++){
+        lsh_snap_put(snap, node->words[n]);
+    }
+    lsh_snap_put_node(snap, node->left);
+    lsh_snap_put_node(snap, node->right);
+}
+
+//the nodes are made in the arena and point into the mapping, lsh_define_function() copies them.
+struct lsh_node *lsh_snap_get_node(struct lsh_snap_reader *r){
+    char *type = lsh_snap_get(r);
+    struct lsh_node *node;
+    int n, i;
+
+    if(type[0] == '\0'){
+        return NULL;
+    }
+    node = lsh_new_node(atoi(type), NULL, NULL);
+    node->name = lsh_snap_get_opt(r);
+    n = atoi(lsh_snap_get(r));
+    if(n > r->end - r->p){
+        r->bad = 1;
+        return NULL;
+    }
+    if(n >= 0){
+        node->words = lsh_arena_alloc((n + 1) * sizeof(char*));
+        for(i = 0; i < n; i++){
+            node->words[i] = lsh_snap_get(r);
+        }
+        node->words[n] = NULL;
+    }
+    node->left = lsh_snap_get_node(r);
+    node->right = lsh_snap_get_node(r);
+    return node;
+}
+
+void lsh_rc_save(const char *path, uint64_t hash){
+    struct lsh_str snap = {NULL, 0, 0}, tmp = {NULL, 0, 0};
+    struct lsh_rc_header header;
+    struct lsh_var *var;
+    struct lsh_func *func;
+    struct lsh_alias *alias;
+    char number[32];
+    int i, fd;
+
+    memset(&header, 0, sizeof(header));
+    lsh_str_append(&snap, (char*)&header, sizeof(header));
+    lsh_str_append(&snap, lsh_rc.reads.data, lsh_rc.reads.len);     //first, so they can be checked before anything is set
+    for(i = 0; i < lsh_rc.set.len; i++){
+        var = lsh_findvar(lsh_rc.set.v[i], strlen(lsh_rc.set.v[i]));
+        lsh_snap_put(&snap, "V");
+        lsh_snap_put(&snap, lsh_rc.set.v[i]);
+        lsh_snap_put_opt(&snap, var ? var->value : NULL);
+        lsh_snap_put(&snap, var && var->exported ? "x" : "");
+    }
+    for(i = 0; i < LSH_FUNC_BUCKETS; i++){
+        for(func = lsh_funcs[i]; func != NULL; func = func->next){
+            lsh_snap_put(&snap, "F");
+            lsh_snap_put(&snap, func->name);
+            lsh_snap_put_node(&snap, func->body);
+        }
+    }
+    for(i = 0; i < LSH_ALIAS_BUCKETS; i++){
+        for(alias = lsh_aliases[i]; alias != NULL; alias = alias->next){
+            lsh_snap_put(&snap, "A");
+            lsh_snap_put(&snap, alias->name);
+            lsh_snap_put(&snap, alias->value);
+        }
+    }
+    for(i = 0; i < lsh_num_options(); i++){
+        snprintf(number, sizeof(number), "%d", *option_val[i]);
+        lsh_snap_put(&snap, "O");
+        lsh_snap_put(&snap, option_str[i]);
+        lsh_snap_put(&snap, number);
+    }
+    for(i = 0; i <= NSIG; i++){
+        if(lsh_traps[i] != NULL){
+            snprintf(number, sizeof(number), "%d", i);
+            lsh_snap_put(&snap, "T");
+            lsh_snap_put(&snap, number);
+            lsh_snap_put(&snap, lsh_traps[i]);
+        }
+    }
+    memcpy(header.magic, LSH_RC_MAGIC, sizeof(header.magic));
+    header.hash = hash;
+    header.size = snap.len;
+    memcpy(snap.data, &header, sizeof(header));
+
+    //write it next to the old one and rename() it over, a shell starting meanwhile sees the old or the new one
+    lsh_str_append(&tmp, path, strlen(path));
+    lsh_str_append(&tmp, ".XXXXXX", 7);
+    fd = mkostemp(tmp.data, O_CLOEXEC);
+    if(fd >= 0){
+        if(lsh_write_all(fd, snap.data, snap.len) != 0 || close(fd) != 0 || rename(tmp.data, path) != 0){
+            unlink(tmp.data);
+        }
+    }
+    free(tmp.data);
+    free(snap.data);
+}
+
+//set the state from the snapshot at path if it is for the file with this hash. returns 0 if it can't be used.
+int lsh_rc_load(const char *path, uint64_t hash){
+    struct lsh_rc_header *header;
+    struct lsh_snap_reader r = {NULL, NULL, 0};
+    struct lsh_node *body;
+    struct stat st;
+    char *map, *kind, *name, *value, *flag, *current;
+    int fd, ok = 1, i, sig;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        return 0;
+    }
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*header)
+       || (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED){
+        close(fd);
+        return 0;
+    }
+    close(fd);
+    header = (struct lsh_rc_header*)map;
+    if(memcmp(header->magic, LSH_RC_MAGIC, sizeof(header->magic)) != 0 || header->hash != hash
+       || header->size != (uint64_t)st.st_size){
+        munmap(map, st.st_size);
+        return 0;
+    }
+    r.p = map + sizeof(*header);
+    r.end = map + st.st_size;
+
+    while(ok && r.p < r.end && strcmp(r.p, "R") == 0){      //the variables it read must still be the same
+        lsh_snap_get(&r);
+        name = lsh_snap_get(&r);
+        value = lsh_snap_get_opt(&r);
+        current = lsh_getvar(name, strlen(name));
+        ok = !r.bad && (value == NULL ? current == NULL : current != NULL && strcmp(value, current) == 0);
+    }
+    while(ok && !r.bad && r.p < r.end){
+        kind = lsh_snap_get(&r);
+        name = lsh_snap_get(&r);
+        if(strcmp(kind, "V") == 0){
+            value = lsh_snap_get_opt(&r);
+            flag = lsh_snap_get(&r);
+            if(r.bad){
+                break;
+            }
+            if(value == NULL){
+                lsh_unsetvar(name);
+            }
+            else{
+                lsh_setvar(name, value, flag[0] == 'x');
+            }
+        }
+        else if(strcmp(kind, "F") == 0){
+            body = lsh_snap_get_node(&r);
+            if(!r.bad){
+                lsh_define_function(name, body);
+            }
+        }
+        else if(strcmp(kind, "A") == 0){
+            value = lsh_snap_get(&r);
+            if(!r.bad){
+                lsh_set_alias(name, value);
+            }
+        }
+        else if(strcmp(kind, "O") == 0){
+            value = lsh_snap_get(&r);
+            for(i = 0; i < lsh_num_options(); i++){
+                if(strcmp(name, option_str[i]) == 0){
+                    *option_val[i] = atoi(value);
+                }
+            }
+        }
+        else if(strcmp(kind, "T") == 0){
+            value = lsh_snap_get(&r);
+            sig = atoi(name);
+            if(!r.bad && sig >= 0 && sig <= NSIG){
+                lsh_set_trap(sig, value);
+            }
+        }
+        else{
+            r.bad = 1;
+        }
+    }
+    munmap(map, st.st_size);
+    return ok && !r.bad;
+}
+
+/*
+function: lsh_load_rc
+run ~/.lshrc, or take its state from the snapshot if that is still good.
+*/
+void lsh_load_rc(void){
+    struct lsh_str path = {NULL, 0, 0}, snap = {NULL, 0, 0}, text = {NULL, 0, 0};
+    const char *home = getenv("HOME");
+    char buf[4096];
+    ssize_t n;
+    uint64_t hash;
+    int fd, status, i;
+
+    if(home == NULL){
+        return;
+    }
+    lsh_str_append(&path, home, strlen(home));
+    lsh_str_append(&path, "/" LSH_RC, strlen("/" LSH_RC));
+    fd = open(path.data, O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        free(path.data);
+        return;
+    }
+    lsh_str_append(&text, "", 0);
+    while((n = read(fd, buf, sizeof(buf))) > 0){
+        lsh_str_append(&text, buf, n);
+    }
+    close(fd);
+    hash = lsh_rc_hash(text.data, text.len);
+    lsh_str_append(&snap, path.data, path.len);
+    lsh_str_append(&snap, ".snap", 5);
+
+    if(!lsh_rc_load(snap.data, hash)){
+        lsh_rc.on = 1;
+        lsh_rc.pure = 1;
+        status = lsh_run(text.data);
+        lsh_rc.on = 0;
+        if(lsh_rc.pure && status){
+            lsh_rc_save(snap.data, hash);
+        }
+        for(i = 0; i < lsh_rc.seen.len; i++){
+            free(lsh_rc.seen.v[i]);
+        }
+        for(i = 0; i < lsh_rc.set.len; i++){
+            free(lsh_rc.set.v[i]);
+        }
+        free(lsh_rc.seen.v);
+        free(lsh_rc.set.v);
+        free(lsh_rc.reads.data);
+        if(!status){        //the file said "exit"
+            lsh_run_exit_trap();
+            exit(lsh_last_status);
+        }
+    }
+    lsh_arena_reset();
+    free(path.data);
+    free(snap.data);
+    free(text.data);
+}
+
+/*
+memo. build scripts run the same converter on the same files again and again. "memo -i in.svg -e LANG convert in.svg
+out.png" runs the command once and keeps what it printed and its exit status. the next time, with the same words, the
+same working directory, the same NAME=value words in front of it, the same values of the -e variables and the same
+contents of the -i files, it prints that again instead of running anything. the key is a hash of all of it, the entry
+is a file named after the key in $XDG_CACHE_HOME/lsh/memo (~/.cache/lsh/memo). only what is declared is in the key,
+so the command gets /dev/null as stdin.
+the command is a program (see lsh_launch_command()), pin can come in between.
+the output still shows up while the command runs: a thread relays its stdout and stderr pipes and keeps a copy. a run
+killed by a signal, stopped, one that couldn't be run (126 or 127, the program may be installed later), or with more
+output than a quarter of the cache isn't kept. "set -o memosize=N" bounds the cache to N megabytes (0 keeps nothing),
+a hit touches the entry, and when a new one makes the cache too big the ones not used for the longest time go.
+*/
+#define LSH_MEMO_MAGIC "lshmemo1"
+
+struct lsh_memo_header{
+    char magic[8];
+    int32_t status;
+    uint32_t unused;
+    uint64_t len[2];        //stdout and stderr, they follow the header
+};
+
+struct lsh_memo_run{
+    int in[2];      //the read ends of the command's stdout and stderr
+    int to[2];      //and where the relay writes them, our stdout and stderr
+    struct lsh_str data[2];
+    size_t max;
+    int too_big;
+    atomic_int refs;        //the relay and the shell, whoever lets go last frees it
+};
+
+void lsh_memo_release(struct lsh_memo_run *run){
+    if(atomic_fetch_sub(&run->refs, 1) == 1){
+        free(run->data[0].data);
+        free(run->data[1].data);
+        free(run);
+    }
+}
+
+void *lsh_memo_relay(void *arg){
+    struct lsh_memo_run *run = arg;
+    struct pollfd fds[2] = {{run->in[0], POLLIN, 0}, {run->in[1], POLLIN, 0}};
+    sigset_t pipe_mask;
+    char buf[LSH_COPY_BUF];
+    ssize_t n;
+    int i;
+
+    sigemptyset(&pipe_mask);
+    sigaddset(&pipe_mask, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_mask, NULL);
+    while(fds[0].fd >= 0 || fds[1].fd >= 0){
+        if(poll(fds, 2, -1) < 0){
+            continue;
+        }
+        for(i = 0; i < 2; i++){
+            if(fds[i].fd < 0 || fds[i].revents == 0){
+                continue;
+            }
+            if((n = read(fds[i].fd, buf, sizeof(buf))) <= 0){
+                close(fds[i].fd);       //the command and all it started closed it
+                fds[i].fd = -1;
+                continue;
+            }
+            lsh_write_all(run->to[i], buf, n);
+            if(run->data[0].len + run->data[1].len + n > run->max){
+                run->too_big = 1;
+            }
+            else if(!run->too_big){
+                lsh_str_append(&run->data[i], buf, n);
+            }
+        }
+    }
+    close(run->to[0]);
+    close(run->to[1]);
+    lsh_memo_release(run);
+    return NULL;
+}
+
+void lsh_memo_hash(uint64_t h[2], const char *s, size_t n){
+    size_t i;
+
+    for(i = 0; i < n; i++){
+        h[0] = (h[0] ^ (unsigned char)s[i]) * 1099511628211ULL;     //FNV-1a twice, from two bases, for 128 bits
+        h[1] = (h[1] ^ (unsigned char)s[i]) * 1099511628211ULL;
+    }
+}
+
+//$XDG_CACHE_HOME/lsh/memo or ~/.cache/lsh/memo, made if it isn't there. -1 if there is no home for it.
+int lsh_memo_dir(struct lsh_str *dir){
+    const char *base = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+    char *p;
+
+    dir->len = 0;
+    if(base != NULL && base[0] == '/'){
+        lsh_str_append(dir, base, strlen(base));
+    }
+    else if(home != NULL){
+        lsh_str_append(dir, home, strlen(home));
+        lsh_str_append(dir, "/.cache", 7);
+    }
+    else{
+        return -1;
+    }
+    lsh_str_append(dir, "/lsh/memo", 9);
+    for(p = strchr(dir->data + 1, '/'); ; p = strchr(p + 1, '/')){
+        if(p != NULL){
+            *p = '\0';
+        }
+        if(mkdir(dir->data, 0700) < 0 && errno != EEXIST){
+            return -1;
+        }
+        if(p == NULL){
+            return 0;
+        }
+        *p = '/';
+    }
+}
+
+//print what the entry at path kept and set the status. 0 if there is no good entry.
+int lsh_memo_replay(const char *path){
+    struct lsh_memo_header header;
+    struct stat st;
+    char *map;
+    int fd;
+
+    if((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0){
+        return 0;
+    }
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(header) || read(fd, &header, sizeof(header)) != sizeof(header)
+       || memcmp(header.magic, LSH_MEMO_MAGIC, sizeof(header.magic)) != 0
+       || (uint64_t)st.st_size != sizeof(header) + header.len[0] + header.len[1]){
+        close(fd);
+        return 0;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED){
+        close(fd);
+        return 0;
+    }
+    fflush(stdout);
+    lsh_write_all(STDOUT_FILENO, map + sizeof(header), header.len[0]);
+    lsh_write_all(STDERR_FILENO, map + sizeof(header) + header.len[0], header.len[1]);
+    munmap(map, st.st_size);
+    futimens(fd, NULL);     //used now, the last to go
+    close(fd);
+    lsh_last_status = header.status;
+    return 1;
+}
+
+struct lsh_memo_entry{
+    char *name;
+    off_t size;
+    struct timespec used;
+};
+
+int lsh_memo_older(const void *a, const void *b){
+    const struct lsh_memo_entry *x = a, *y = b;
+
+    if(x->used.tv_sec != y->used.tv_sec){
+        return x->used.tv_sec < y->used.tv_sec ? -1 : 1;
+    }
+    return x->used.tv_nsec < y->used.tv_nsec ? -1 : x->used.tv_nsec > y->used.tv_nsec;
+}
+
+//throw out the entries used the longest time ago until the cache is back under 90% of its size.
+void lsh_memo_evict(const char *dir, off_t limit){
+    struct lsh_memo_entry *entries = NULL;
+    struct dirent *d;
+    struct stat st;
+    DIR *dp = opendir(dir);
+    off_t total = 0;
+    int n = 0, cap = 0, i;
+
+    if(dp == NULL){
+        return;
+    }
+    while((d = readdir(dp)) != NULL){
+        if(strchr(d->d_name, '.') != NULL || fstatat(dirfd(dp), d->d_name, &st, 0) < 0){
+            continue;       //".", "..", and the entries still being written
+        }
+        if(n == cap){
+            cap = cap ? cap * 2 : 64;
+            entries = realloc(entries, cap * sizeof(*entries));
+            if(!entries){
+                fprintf(stderr,"lsh: allocation error\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        entries[n].name = lsh_strdup(d->d_name);
+        entries[n].size = st.st_size;
+        entries[n++].used = st.st_mtim;
+        total += st.st_size;
+    }
+    if(total > limit){
+        qsort(entries, n, sizeof(*entries), lsh_memo_older);
+        for(i = 0; i < n && total > limit / 10 * 9; i++){
+            if(unlinkat(dirfd(dp), entries[i].name, 0) == 0){
+                total -= entries[i].size;
+            }
+        }
+    }
+    closedir(dp);
+    for(i = 0; i < n; i++){
+        free(entries[i].name);
+    }
+    free(entries);
+}
+
+void lsh_memo_store(struct lsh_str *dir, const char *path, struct lsh_memo_run *run){
+    struct lsh_memo_header header;
+    struct lsh_str tmp = {NULL, 0, 0};
+    int fd;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LSH_MEMO_MAGIC, sizeof(header.magic));
+    header.status = lsh_last_status;
+    header.len[0] = run->data[0].len;
+    header.len[1] = run->data[1].len;
+    lsh_str_append(&tmp, path, strlen(path));
+    lsh_str_append(&tmp, ".XXXXXX", 7);
+    if((fd = mkostemp(tmp.data, O_CLOEXEC)) >= 0){
+        if(lsh_write_all(fd, (char *)&header, sizeof(header)) != 0
+           || lsh_write_all(fd, run->data[0].data ? run->data[0].data : "", run->data[0].len) != 0
+           || lsh_write_all(fd, run->data[1].data ? run->data[1].data : "", run->data[1].len) != 0
+           || close(fd) != 0 || rename(tmp.data, path) != 0){
+            unlink(tmp.data);
+        }
+        lsh_memo_evict(dir->data, (off_t)lsh_memo_size << 20);
+    }
+    free(tmp.data);
+}
+
+//the hash of everything the command's output may depend on, as 32 hex digits.
+void lsh_memo_key(char** args, int cmd, const char *cwd, char *hex){
+    uint64_t h[2] = {14695981039346656037ULL, 9650029242287828579ULL};
+    struct stat st;
+    char *value, *map;
+    int i, fd;
+
+    lsh_memo_hash(h, LSH_MEMO_MAGIC, sizeof(LSH_MEMO_MAGIC));
+    lsh_memo_hash(h, cwd, strlen(cwd) + 1);
+    for(i = 1; i + 1 < cmd && args[i][0] == '-' && args[i][1] != '-'; i += 2){
+        lsh_memo_hash(h, args[i], 3);       //"-i" or "-e", with the NUL
+        lsh_memo_hash(h, args[i + 1], strlen(args[i + 1]) + 1);
+        if(args[i][1] == 'e'){
+            value = getenv(args[i + 1]);
+            lsh_memo_hash(h, value ? "=" : "!", 1);     //empty and unset are not the same
+            lsh_memo_hash(h, value ? value : "", value ? strlen(value) + 1 : 0);
+            continue;
+        }
+        if((fd = open(args[i + 1], O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &st) < 0){
+            lsh_memo_hash(h, "!", 1);       //a missing input is an input too
+        }
+        else if(st.st_size > 0 && (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED){
+            lsh_memo_hash(h, map, st.st_size);
+            munmap(map, st.st_size);
+        }
+        if(fd >= 0){
+            close(fd);
+        }
+    }
+    lsh_memo_hash(h, "\n", 1);
+    for(i = 0; lsh_cmd_assigns != NULL && lsh_cmd_assigns[i] != NULL; i++){
+        lsh_memo_hash(h, lsh_cmd_assigns[i], strlen(lsh_cmd_assigns[i]) + 1);      //"FOO=1 memo cmd", see lsh_execute()
+    }
+    lsh_memo_hash(h, "\n", 1);
+    for(i = cmd; args[i] != NULL; i++){
+        lsh_memo_hash(h, args[i], strlen(args[i]) + 1);
+    }
+    snprintf(hex, 33, "%016llx%016llx", (unsigned long long)h[0], (unsigned long long)h[1]);
+}
+
+//memo [-i file]... [-e name]... command [args...]
+int lsh_memo(char** args){
+    struct lsh_str dir = {NULL, 0, 0}, path = {NULL, 0, 0};
+    struct lsh_memo_run *run;
+    char cwd[PATH_MAX], hex[33];
+    int cmd, fd, saved[3], out[2] = {-1, -1}, err[2] = {-1, -1}, null_fd;
+    pthread_t thread;
+
+    for(cmd = 1; args[cmd] != NULL && args[cmd + 1] != NULL && (strcmp(args[cmd], "-i") == 0 || strcmp(args[cmd], "-e") == 0); cmd += 2){
+    }
+    if(args[cmd] != NULL && strcmp(args[cmd], "--") == 0){
+        cmd++;
+    }
+    if(args[cmd] == NULL || (args[cmd][0] == '-' && strcmp(args[cmd - 1], "--") != 0)){
+        fprintf(stderr, "lsh: usage: memo [-i file]... [-e name]... command [args...]\n");
+        lsh_last_status = 2;
+        return 1;
+    }
+    if(lsh_findfunc(args[cmd]) != NULL || lsh_findalias(args[cmd]) != NULL){
+        return lsh_launch_command("memo", args + cmd);        //refused, and that is not kept either
+    }
+    if(lsh_memo_size <= 0 || lsh_memo_dir(&dir) < 0 || getcwd(cwd, sizeof(cwd)) == NULL){
+        free(dir.data);
+        return lsh_launch_command("memo", args + cmd);        //nowhere to keep anything
+    }
+    lsh_memo_key(args, cmd, cwd, hex);
+    lsh_str_append(&path, dir.data, dir.len);
+    lsh_str_append(&path, "/", 1);
+    lsh_str_append(&path, hex, 32);
+    if(lsh_memo_replay(path.data)){
+        free(dir.data);
+        free(path.data);
+        return 1;
+    }
+
+    //a miss: the command's stdout and stderr are pipes, the relay thread shows and keeps what comes out of them
+    run = calloc(1, sizeof(*run));
+    if(!run){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    run->max = ((size_t)lsh_memo_size << 20) / 4;
+    atomic_init(&run->refs, 2);
+    run->to[0] = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    run->to[1] = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 10);
+    if(pipe2(out, O_CLOEXEC) < 0 || pipe2(err, O_CLOEXEC) < 0 || (run->in[0] = out[0], run->in[1] = err[0],
+                                                                  pthread_create(&thread, NULL, lsh_memo_relay, run) != 0)){
+        for(fd = 0; fd < 2; fd++){
+            if(out[fd] >= 0){
+                close(out[fd]);
+            }
+            if(err[fd] >= 0){
+                close(err[fd]);
+            }
+            close(run->to[fd]);
+        }
+        free(run);
+        free(dir.data);
+        free(path.data);
+        return lsh_launch_command("memo", args + cmd);        //run, just not kept
+    }
+
+    fflush(stdout);
+    for(fd = 0; fd < 3; fd++){
+        saved[fd] = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    }
+    if((null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC)) >= 0){
+        dup2(null_fd, STDIN_FILENO);
+        close(null_fd);
+    }
+    dup2(out[1], STDOUT_FILENO);
+    dup2(err[1], STDERR_FILENO);
+    close(out[1]);
+    close(err[1]);
+
+    lsh_launch_command("memo", args + cmd);
+
+    fflush(stdout);
+    for(fd = 0; fd < 3; fd++){
+        dup2(saved[fd], fd);        //our copies of the write ends go, the relay sees the end when the command's do
+        close(saved[fd]);
+    }
+    if(lsh_last_status == 128 + SIGTSTP){
+        pthread_detach(thread);     //stopped: it relays on whenever the job runs, and nothing is kept
+    }
+    else{
+        pthread_join(thread, NULL);
+        if(!run->too_big && lsh_last_status < 126){        //126 and 127: it couldn't be run, it may be installed later
+            lsh_memo_store(&dir, path.data, run);
+        }
+    }
+    lsh_memo_release(run);
+    free(dir.data);
+    free(path.data);
+    return 1;
+}
+
+//append the tokens of a continuation line to the ones we already have.
+char **lsh_join_tokens(char **tokens, char **more){
+    int n, m;
+
+    for(n = 0; tokens[n] != NULL; n++){
+    }
+    for(m = 0; more[m] != NULL; m++){
+    }
+    tokens = realloc(tokens, (n + m + 1) * sizeof(char*));
+    if(!tokens){
+        fprintf(stderr,"lsh: allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(tokens + n, more, (m + 1) * sizeof(char*));
+    free(more);
+    return tokens;
+}
+
+void lsh_loop(void)
+{
+    char *line;
+    char **args, **more;
+    struct lsh_node *node;
+    struct lsh_str text = {NULL, 0, 0};     //the whole command as typed, for the history
+    struct timespec started, finished;      //for \D in the prompt
+    int status, incomplete;
+
+    //the do-while loop is more convienient for checking the status variable, 
+    //because it executes once before checking its value.
+    do{
+        lsh_reap_jobs();        //tell about the background jobs that finished meanwhile
+        lsh_interrupted = 0;
+        line = lsh_read_line(NULL);     //print the prompt ($PS1) and call a function to read a line
+        if(line == NULL){       //Ctrl-C, start over with a new prompt
+            printf("\n");
+            lsh_last_status = 128 + SIGINT;
+            status = 1;
+            continue;
+        }
+        text.len = 0;
+        lsh_str_append(&text, line, strlen(line));
+        args = lsh_split_line(line);        //call a function to split the line into args
+        free(line);
+        lsh_read_heredocs(args);
+        node = lsh_parse(args, &incomplete);        //and parse them into a tree of commands
+        while(incomplete){      //a command that goes on over several lines
+            line = lsh_read_line("> ");
+            if(line == NULL){       //Ctrl-C drops the whole unfinished command
+                printf("\n");
+                lsh_last_status = 128 + SIGINT;
+                node = NULL;
+                break;
+            }
+            lsh_str_append(&text, line, strlen(line));
+            more = lsh_split_line(line);
+            free(line);
+            lsh_read_heredocs(more);
+            args = lsh_join_tokens(args, more);
+            node = lsh_parse(args, &incomplete);
+        }
+        if(node != NULL && lsh_job_control){
+            lsh_history_add(text.data, text.len);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &started);
+        status = lsh_exec_node(node);         //excute the args
+        clock_gettime(CLOCK_MONOTONIC, &finished);
+        lsh_last_duration = (finished.tv_sec - started.tv_sec) * 1000000000LL + finished.tv_nsec - started.tv_nsec;
+        lsh_cmd_gen++;
+
+        free(args);         //free the arguments that we created earlier.
+        lsh_arena_reset();      //and everything the command line allocated from the arena
+    }while(status);         //using a status variable returned by lsh_executed() to determine when to exit.
+    free(text.data);
+
+}
+
+//a script gets its arguments as $1, $2, ... like the positional parameters of a function.
+void lsh_open_script(char **argv){
+    static struct lsh_frame frame;
+
+    lsh_script = fopen(argv[0], "re");
+    if(lsh_script == NULL){
+        fprintf(stderr, "lsh: %s: %s\n", argv[0], strerror(errno));
+        exit(127);
+    }
+    frame.argv = argv;
+    for(frame.argc = 0; argv[frame.argc + 1] != NULL; frame.argc++){
+    }
+    lsh_frame = &frame;
+}
+
+/*
+function: lsh_main
+everything after the job control is set up, script is NULL or the script and its arguments. the zygote's copies
+start here too.
+*/
+int lsh_main(char **script){
+    lsh_init_vars();
+    if(script != NULL){
+        lsh_open_script(script);
+    }
+    lsh_init_signals();
+    lsh_init_history();
+    if(lsh_job_control){
+        lsh_load_rc();      //the config file, ~/.lshrc
+        lsh_init_prompt();
+        lsh_cmd_index_start();      //Tab will need it, build it while the user types the first command
+    }
+
+    // TODO: Run command loop.
+    lsh_loop();
+    lsh_run_exit_trap();
+
+    // TODO: Perform any shutdown/clearup
+
+    return script ? lsh_last_status : EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc > 1){       //lsh file args...
+        return lsh_main(argv + 1);
+    }
+    lsh_init_job_control();
+    if(lsh_job_control){
+        lsh_zygote_start();     //before there is any state, its copies start out like a new shell
+    }
+    return lsh_main(NULL);
+}